@@ -0,0 +1,167 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "RenderBenchmark.h"
+#include "RealtimeMonitor.h"
+
+/*
+* Plays the same pattern twice: once in blocks of the
+* prepared size, once in blocks of random sizes up to it,
+* with the block size changed through prepareToPlay halfway
+* as some hosts do. Passes if processBlock never allocated
+* or locked and both renders match, notes being sample accurate.
+*/
+class BlockSizeFuzz
+{
+public:
+    enum
+    {
+        loadTimeoutMs = 10000,
+        seed = 0x5eed
+    };
+
+    BlockSizeFuzz(const BenchmarkOptions& optionsToUse) : options(optionsToUse) { }
+
+    /*
+    * Returns true if the fuzzed render passed.
+    */
+    bool run()
+    {
+        RealtimeMonitor::reset();
+
+        Stats reference, fuzzed;
+        auto expected = render(nullptr, reference);
+
+        Random random(seed);
+        auto output = render(&random, fuzzed);
+
+        auto maxDifference = 0.0f;
+
+        for (auto ch = 0; ch < jmin(expected.getNumChannels(), output.getNumChannels()); ++ch)
+            for (auto i = 0; i < expected.getNumSamples(); ++i)
+                maxDifference = jmax(maxDifference, std::abs(expected.getSample(ch, i) - output.getSample(ch, i)));
+
+        auto passed = fuzzed.numViolations == 0 && reference.numViolations == 0 && maxDifference <= tolerance;
+
+        std::cout << "DrumSampler block size fuzz" << std::endl
+                  << "  pattern:         " << MidiPattern::getName(options.pattern) << std::endl
+                  << "  sample rate:     " << options.sampleRate << " Hz" << std::endl
+                  << "  max block size:  " << options.blockSize << std::endl
+                  << "  blocks:          " << fuzzed.numBlocks << " (" << fuzzed.minBlock << " to "
+                  << fuzzed.maxBlock << " samples, seed " << (int) seed << ")" << std::endl
+                  << "  violations:      " << fuzzed.numViolations << " in processBlock ("
+                  << reference.numViolations << " at fixed size)" << std::endl
+                  << "  max difference:  " << maxDifference << " against fixed size blocks" << std::endl;
+
+        // Both renders are recorded together
+        if (fuzzed.numViolations + reference.numViolations > 0)
+            RealtimeMonitor::printReport();
+
+        std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+
+        return passed;
+    }
+
+private:
+    static constexpr float tolerance = 1.0e-4f;
+
+    struct Stats
+    {
+        int64 numViolations = 0;
+        int numBlocks = 0;
+        int minBlock = std::numeric_limits<int>::max();
+        int maxBlock = 0;
+    };
+
+    /*
+    * Renders the whole pattern, in random blocks if a
+    * generator is given, and returns the master output.
+    */
+    AudioBuffer<float> render(Random* random, Stats& stats)
+    {
+        DrumProcessor processor;
+        processor.setMidiRoutingEnabled(options.midiRouting);
+        processor.setActiveVoiceListEnabled(options.activeVoiceList);
+        processor.setMeteringEnabled(options.metering);
+        processor.getSampleLoader().waitUntilIdle(loadTimeoutMs);
+
+        Array<int> notes;
+        auto kit = processor.getKit();
+
+        for (auto* s : kit->getSynths())
+            notes.add(s->getMidiNote());
+
+        MidiPattern pattern(options.pattern, notes, options.sampleRate, options.bpm, options.seconds);
+
+        auto maxBlockSize = options.blockSize;
+        auto totalSamples = (int) (options.seconds * options.sampleRate);
+        auto numChannels = processor.getTotalNumOutputChannels();
+
+        AudioBuffer<float> output(numChannels, totalSamples);
+        AudioBuffer<float> block(numChannels, maxBlockSize);
+        MidiBuffer midi;
+        midi.ensureSize((size_t) pattern.getMaxEventsPerBlock(maxBlockSize) * 4 * sizeof(MidiMessage));
+
+        processor.setRateAndBufferSizeDetails(options.sampleRate, maxBlockSize);
+        processor.prepareToPlay(options.sampleRate, maxBlockSize);
+        processor.getSampleLoader().waitUntilIdle(loadTimeoutMs);
+
+        auto violationsBefore = RealtimeMonitor::getNumViolations();
+
+        for (auto position = 0; position < totalSamples;)
+        {
+            // Host shrinks then restores its block size in the middle
+            auto phase = (position * 4) / totalSamples;
+            auto limit = phase == 2 ? jmax(1, maxBlockSize / 3) : maxBlockSize;
+
+            if (random != nullptr && (phase == 2 || phase == 3) && limit != processor.getBlockSize())
+            {
+                processor.setRateAndBufferSizeDetails(options.sampleRate, limit);
+                processor.prepareToPlay(options.sampleRate, limit);
+            }
+
+            auto numSamples = random != nullptr ? getRandomSize(*random, limit) : maxBlockSize;
+            numSamples = jmin(numSamples, totalSamples - position);
+
+            AudioBuffer<float> view(block.getArrayOfWritePointers(), numChannels, numSamples);
+            pattern.fillBlock(midi, position, numSamples);
+
+            {
+                RealtimeMonitor::ScopedAudioThread audioThread;
+                processor.processBlock(view, midi);
+            }
+
+            for (auto ch = 0; ch < numChannels; ++ch)
+                output.copyFrom(ch, position, view, ch, 0, numSamples);
+
+            position += numSamples;
+            ++stats.numBlocks;
+            stats.minBlock = jmin(stats.minBlock, numSamples);
+            stats.maxBlock = jmax(stats.maxBlock, numSamples);
+        }
+
+        stats.numViolations = RealtimeMonitor::getNumViolations() - violationsBefore;
+        processor.releaseResources();
+
+        return output;
+    }
+
+    /*
+    * Mostly uniform sizes, with single samples and
+    * full blocks more often than chance would give.
+    */
+    static int getRandomSize(Random& random, int limit)
+    {
+        auto choice = random.nextInt(8);
+
+        if (choice == 0)
+            return 1;
+
+        if (choice == 1)
+            return limit;
+
+        return random.nextInt(limit) + 1;
+    }
+
+    BenchmarkOptions options;
+};
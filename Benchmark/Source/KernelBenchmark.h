@@ -0,0 +1,229 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/dsp/VoiceRenderKernel.h"
+
+/*
+* Times VoiceRenderKernel against the per-sample loop
+* DrumVoice used before, on a synthetic sample, for a few
+* pitch ratios and both mono and stereo sources.
+* Then times every interpolation mode, as the cost of
+* one voice and how many voices fit in real time, and the
+* cost of a block against the number of voices mixed into it.
+*/
+class KernelBenchmark
+{
+public:
+    enum
+    {
+        sampleLength = 1 << 18,
+        blockSize = 512,
+        numRuns = 2000
+    };
+
+    KernelBenchmark() : sample(2, sampleLength), output(2, blockSize)
+    {
+        Random random(1234);
+
+        for (auto ch = 0; ch < sample.getNumChannels(); ++ch)
+            for (auto i = 0; i < sampleLength; ++i)
+                sample.setSample(ch, i, random.nextFloat() * 2.0f - 1.0f);
+    }
+
+    void run(double sampleRate)
+    {
+        std::cout << "Voice render kernel, " << blockSize << " frames per call (ns per frame)" << std::endl;
+
+        for (auto ratio : { 1.0, 0.918, 1.5 })
+        {
+            for (auto numChannels : { 1, 2 })
+            {
+                auto legacy = time(ratio, numChannels, false, VoiceRenderKernel::linear);
+                auto kernel = time(ratio, numChannels, true, VoiceRenderKernel::linear);
+                auto error = compare(ratio, numChannels);
+
+                std::cout << "  ratio " << ratio << (numChannels > 1 ? ", stereo: " : ", mono:   ")
+                          << "scalar " << legacy << ", kernel " << kernel
+                          << " (" << (kernel > 0.0 ? legacy / kernel : 0.0) << "x)"
+                          << ", max difference " << error << std::endl;
+            }
+        }
+
+        std::cout << std::endl << "Cost per stereo voice at " << sampleRate << " Hz" << std::endl;
+
+        for (auto mode = 0; mode < VoiceRenderKernel::numInterpolations; ++mode)
+        {
+            for (auto ratio : { 0.5, 0.918, 1.5, 3.0, 8.0 })
+            {
+                auto nsPerFrame = time(ratio, 2, true, (VoiceRenderKernel::Interpolation) mode);
+                auto loadPerVoice = nsPerFrame * 1.0e-9 * sampleRate;
+
+                std::cout << "  " << VoiceRenderKernel::getInterpolationName(mode).paddedRight(' ', 8)
+                          << " ratio " << ratio << ": " << nsPerFrame << " ns per frame, "
+                          << 100.0 * loadPerVoice << "% of one core, "
+                          << (loadPerVoice > 0.0 ? (int) (1.0 / loadPerVoice) : 0) << " voices max" << std::endl;
+            }
+        }
+
+        std::cout << std::endl << "Block time against active voices, ratio 0.918 (us per block)" << std::endl;
+
+        for (auto numVoices : { 1, 4, 16, 64 })
+        {
+            auto perVoiceGain = timeVoices(numVoices, false);
+            auto foldedGain = timeVoices(numVoices, true);
+
+            std::cout << "  " << String(numVoices).paddedLeft(' ', 2) << " voices: "
+                      << "gain on whole buffer " << perVoiceGain << ", gain in mix " << foldedGain
+                      << " (" << (foldedGain > 0.0 ? perVoiceGain / foldedGain : 0.0) << "x)" << std::endl;
+        }
+    }
+
+private:
+    double time(double ratio, int numChannels, bool useKernel, VoiceRenderKernel::Interpolation mode)
+    {
+        auto position = 0.0;
+        auto start = Time::getHighResolutionTicks();
+
+        for (auto run = 0; run < numRuns; ++run)
+        {
+            // Wrap before reaching the end, like a new note would
+            if (position + (blockSize + 1) * ratio >= sampleLength - VoiceRenderKernel::maxTapsAfter)
+                position = 0.0;
+
+            position = render(ratio, numChannels, useKernel, mode, position);
+        }
+
+        auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+        return elapsed * 1.0e9 / ((double) numRuns * blockSize);
+    }
+
+    /*
+    * Mixes numVoices voices into one block, each with its own gain
+    * ramp, as DrumVoice does now, or with the gain applied to the
+    * whole buffer after each voice as it used to.
+    */
+    double timeVoices(int numVoices, bool foldGainInMix)
+    {
+        const auto ratio = 0.918;
+        VoiceRenderKernel::PlanarSource source { { sample.getReadPointer(0), sample.getReadPointer(1) } };
+        VoiceRenderKernel::Interpolator interpolator(VoiceRenderKernel::linear, ratio, *sincTable);
+
+        std::vector<VoiceRenderKernel::Gain> gains((size_t) numVoices * 2);
+        std::vector<double> positions((size_t) numVoices);
+
+        for (auto v = 0; v < numVoices; ++v)
+        {
+            positions[(size_t) v] = v * 1000.0;
+            gains[(size_t) v * 2].reset(44100.0, 0.02);
+            gains[(size_t) v * 2 + 1].reset(44100.0, 0.02);
+        }
+
+        auto start = Time::getHighResolutionTicks();
+
+        for (auto run = 0; run < numRuns / 10; ++run)
+        {
+            output.clear();
+
+            // Gains keep moving, as if the level was automated
+            auto target = (run & 1) != 0 ? 0.9f : 0.7f;
+
+            for (auto v = 0; v < numVoices; ++v)
+            {
+                auto& position = positions[(size_t) v];
+                auto& gainL = gains[(size_t) v * 2];
+                auto& gainR = gains[(size_t) v * 2 + 1];
+
+                if (position + (blockSize + 1) * ratio >= sampleLength - VoiceRenderKernel::maxTapsAfter)
+                    position = 0.0;
+
+                if (foldGainInMix)
+                {
+                    gainL.setTargetValue(target);
+                    gainR.setTargetValue(target);
+                    position = VoiceRenderKernel::render<2>(source, output.getWritePointer(0), output.getWritePointer(1),
+                                                            blockSize, position, ratio, interpolator, gainL, gainR);
+                }
+                else
+                {
+                    position = VoiceRenderKernel::render<2>(source, output.getWritePointer(0), output.getWritePointer(1),
+                                                            blockSize, position, ratio, interpolator, 1.0f, 1.0f);
+                    output.applyGainRamp(0, blockSize, gainL.getCurrentValue(), target);
+                    gainL.setCurrentAndTargetValue(target);
+                }
+            }
+        }
+
+        auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+        return elapsed * 1.0e6 / (numRuns / 10);
+    }
+
+    /*
+    * Returns the largest difference between the two renders of one block.
+    */
+    float compare(double ratio, int numChannels)
+    {
+        AudioBuffer<float> reference(2, blockSize);
+
+        render(ratio, numChannels, false, VoiceRenderKernel::linear, 0.25);
+        reference.makeCopyOf(output);
+        render(ratio, numChannels, true, VoiceRenderKernel::linear, 0.25);
+
+        auto maxError = 0.0f;
+
+        for (auto ch = 0; ch < 2; ++ch)
+            for (auto i = 0; i < blockSize; ++i)
+                maxError = jmax(maxError, std::abs(output.getSample(ch, i) - reference.getSample(ch, i)));
+
+        return maxError;
+    }
+
+    double render(double ratio, int numChannels, bool useKernel, VoiceRenderKernel::Interpolation mode, double position)
+    {
+        output.clear();
+
+        auto* outL = output.getWritePointer(0);
+        auto* outR = output.getWritePointer(1);
+        const float gainL = 0.8f, gainR = 1.0f;
+
+        if (!useKernel)
+            return renderScalar(numChannels, outL, outR, position, ratio, gainL, gainR);
+
+        VoiceRenderKernel::PlanarSource source { { sample.getReadPointer(0), sample.getReadPointer(numChannels - 1) } };
+        VoiceRenderKernel::Interpolator interpolator(mode, ratio, *sincTable);
+
+        if (numChannels > 1)
+            return VoiceRenderKernel::render<2>(source, outL, outR, blockSize, position, ratio, interpolator, gainL, gainR);
+
+        return VoiceRenderKernel::render<1>(source, outL, outR, blockSize, position, ratio, interpolator, gainL, gainR);
+    }
+
+    /*
+    * The per-sample loop DrumVoice::renderNextBlock used before the kernel.
+    */
+    double renderScalar(int numChannels, float* outL, float* outR, double position, double ratio, float gainL, float gainR)
+    {
+        const float* const inL = sample.getReadPointer(0);
+        const float* const inR = numChannels > 1 ? sample.getReadPointer(1) : nullptr;
+        const bool isStereo = inR != nullptr;
+
+        for (auto i = 0; i < blockSize; ++i)
+        {
+            auto pos = (int) position;
+            auto alpha = (float) (position - pos);
+            auto invAlpha = 1.0f - alpha;
+
+            auto l = (inL[pos] * invAlpha + inL[pos + 1] * alpha);
+            auto r = isStereo ? (inR[pos] * invAlpha + inR[pos + 1] * alpha) : l;
+
+            *outL++ += l * gainL;
+            *outR++ += r * gainR;
+
+            position += ratio;
+        }
+
+        return position;
+    }
+
+    AudioBuffer<float> sample, output;
+    SharedResourcePointer<SincTable> sincTable;
+};
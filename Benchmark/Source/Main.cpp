@@ -0,0 +1,217 @@
+#include <JuceHeader.h>
+#include "RenderBenchmark.h"
+#include "KernelBenchmark.h"
+#include "BlockSizeFuzz.h"
+
+static void printUsage()
+{
+    std::cout << "Usage: DrumSamplerBenchmark [options]" << std::endl
+              << "  --seconds=<n>        length of the rendered performance (default 10)" << std::endl
+              << "  --rate=<hz>          sample rate (default 44100)" << std::endl
+              << "  --block=<n>          block size in samples (default 512)" << std::endl
+              << "  --bpm=<n>            tempo of the midi pattern (default 180)" << std::endl
+              << "  --pattern=<name>     blast, roll, flam, dense or all (default all)" << std::endl
+              << "  --midi-routing=<m>   on, off or compare (default on)" << std::endl
+              << "  --voice-list=<m>     on, off or compare: render active voices only (default on)" << std::endl
+              << "  --perf-log=<file>    write the processor's per-block counters to a CSV file" << std::endl
+              << "  --kit=<file>         switch to this kit half way through and time the switching block" << std::endl
+              << "  --meters=<m>         on, off or compare: channel and master meters (default on)" << std::endl
+              << "  --threads=<n>        threads rendering channels, audio thread included, or compare (default 1)" << std::endl
+              << "                       only one of --midi-routing, --voice-list, --meters and --threads can be compare" << std::endl
+              << "  --root=<dir>         project root containing Source/ and Resources/" << std::endl
+              << "  --kernel             time the voice render kernel and each interpolation mode, no samples needed" << std::endl
+              << "  --fuzz-blocks        play in random block sizes up to --block, fail on allocations in processBlock" << std::endl
+              << "  --rt-check           report allocations and locks in processBlock, fail if any" << std::endl;
+}
+
+/*
+* Runs the benchmark with the old and new path of a feature,
+* then prints how much the new one saves on median block time.
+*/
+static void runComparison(BenchmarkOptions options, bool BenchmarkOptions::* feature)
+{
+    options.*feature = false;
+    RenderBenchmark before(options);
+    auto beforeResults = before.run();
+    before.printResults(beforeResults);
+
+    options.*feature = true;
+    RenderBenchmark after(options);
+    auto afterResults = after.run();
+    after.printResults(afterResults);
+
+    auto beforeTime = beforeResults.getPercentile(50.0);
+    auto afterTime = afterResults.getPercentile(50.0);
+
+    std::cout << "Median block time saving: " << (beforeTime - afterTime) << " us ("
+              << (beforeTime > 0.0 ? 100.0 * (beforeTime - afterTime) / beforeTime : 0.0) << "%)" << std::endl;
+}
+
+/*
+* Runs the benchmark rendering channels on 1, 2, 4 and 8 threads,
+* then prints block times, realtime factor and speedup against a single thread.
+*/
+static void runThreadComparison(BenchmarkOptions options)
+{
+    Array<BenchmarkResults> results;
+    const int threadCounts[] = { 1, 2, 4, 8 };
+
+    for (auto numThreads : threadCounts)
+    {
+        options.renderThreads = numThreads;
+        RenderBenchmark benchmark(options);
+        results.add(benchmark.run());
+        benchmark.printResults(results.getReference(results.size() - 1));
+    }
+
+    std::cout << "Render threads: p50 / p99 block time (us), realtime factor, speedup at p50" << std::endl;
+
+    for (auto i = 0; i < results.size(); ++i)
+    {
+        auto& r = results.getReference(i);
+        auto p50 = r.getPercentile(50.0);
+
+        std::cout << "  " << threadCounts[i] << ": " << p50 << " / " << r.getPercentile(99.0)
+                  << ", " << r.getRealtimeFactor() << "x realtime"
+                  << ", " << (p50 > 0.0 ? results.getReference(0).getPercentile(50.0) / p50 : 0.0) << "x" << std::endl;
+    }
+}
+
+/*
+* Looks for the project root walking up from the executable,
+* so the benchmark can run from any build folder.
+*/
+static File findProjectRoot()
+{
+    auto dir = File::getSpecialLocation(File::currentExecutableFile).getParentDirectory();
+
+    while (dir != dir.getParentDirectory())
+    {
+        if (dir.getChildFile("Source/utils/mixer_info.xml").existsAsFile())
+            return dir;
+
+        dir = dir.getParentDirectory();
+    }
+
+    return DrumsetXmlHandler::getProjectRoot();
+}
+
+int main(int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+    ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    if (args.containsOption("--kernel"))
+    {
+        auto sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 44100.0;
+        KernelBenchmark().run(sampleRate);
+        return 0;
+    }
+
+    BenchmarkOptions options;
+    auto root = findProjectRoot();
+
+    if (args.containsOption("--seconds"))
+        options.seconds = args.getValueForOption("--seconds").getDoubleValue();
+
+    if (args.containsOption("--rate"))
+        options.sampleRate = args.getValueForOption("--rate").getDoubleValue();
+
+    if (args.containsOption("--block"))
+        options.blockSize = args.getValueForOption("--block").getIntValue();
+
+    if (args.containsOption("--bpm"))
+        options.bpm = args.getValueForOption("--bpm").getDoubleValue();
+
+    if (args.containsOption("--pattern"))
+        options.pattern = MidiPattern::fromName(args.getValueForOption("--pattern"));
+
+    auto midiRouting = args.containsOption("--midi-routing") ? args.getValueForOption("--midi-routing")
+                                                             : String("on");
+    auto voiceList = args.containsOption("--voice-list") ? args.getValueForOption("--voice-list")
+                                                         : String("on");
+    auto meters = args.containsOption("--meters") ? args.getValueForOption("--meters")
+                                                  : String("on");
+    auto threads = args.containsOption("--threads") ? args.getValueForOption("--threads")
+                                                    : String("1");
+
+    if (args.containsOption("--root"))
+        root = File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--root"));
+
+    // Only one feature can be compared per run
+    auto numCompares = 0;
+
+    for (auto& mode : StringArray(midiRouting, voiceList, meters, threads))
+        if (mode == "compare")
+            ++numCompares;
+
+    if (options.seconds <= 0.0 || options.sampleRate <= 0.0 || options.blockSize <= 0
+        || options.bpm <= 0.0 || options.pattern == MidiPattern::numTypes
+        || !StringArray("on", "off", "compare").contains(midiRouting)
+        || !StringArray("on", "off", "compare").contains(voiceList)
+        || !StringArray("on", "off", "compare").contains(meters)
+        || (threads != "compare" && threads.getIntValue() <= 0)
+        || numCompares > 1)
+    {
+        printUsage();
+        return 1;
+    }
+
+    DrumsetXmlHandler::setProjectRoot(root);
+
+    options.midiRouting = midiRouting != "off";
+    options.activeVoiceList = voiceList != "off";
+    options.metering = meters != "off";
+    options.realtimeCheck = args.containsOption("--rt-check");
+    options.renderThreads = threads == "compare" ? 1 : threads.getIntValue();
+
+    if (args.containsOption("--perf-log"))
+        options.performanceLog = File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--perf-log"));
+
+    if (args.containsOption("--kit"))
+        options.kitSwap = File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--kit"));
+
+    // Exit code tells scripts whether it passed
+    if (args.containsOption("--fuzz-blocks"))
+        return BlockSizeFuzz(options).run() ? 0 : 1;
+
+    // Same pattern with and without the note routing table
+    if (midiRouting == "compare")
+    {
+        runComparison(options, &BenchmarkOptions::midiRouting);
+        return 0;
+    }
+
+    // Same pattern visiting every voice or only the active ones
+    if (voiceList == "compare")
+    {
+        runComparison(options, &BenchmarkOptions::activeVoiceList);
+        return 0;
+    }
+
+    // Same pattern without and with meters: the saving is what they cost
+    if (meters == "compare")
+    {
+        runComparison(options, &BenchmarkOptions::metering);
+        return 0;
+    }
+
+    // Same pattern on 1, 2, 4 and 8 render threads
+    if (threads == "compare")
+    {
+        runThreadComparison(options);
+        return 0;
+    }
+
+    RenderBenchmark benchmark(options);
+    auto results = benchmark.run();
+    benchmark.printResults(results);
+
+    return options.realtimeCheck && results.numRealtimeViolations > 0 ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* A scripted midi performance, rendered block by block
+* into the midi buffer passed to the processor.
+* Events are generated up front so filling a block
+* only copies the events falling inside it.
+*/
+class MidiPattern
+{
+public:
+    enum Type
+    {
+        blastBeat = 0,
+        roll,
+        flam,
+        dense,
+        all,
+        numTypes
+    };
+
+    MidiPattern(Type typeToUse,
+                const Array<int>& notesToUse,
+                double sampleRateToUse,
+                double bpmToUse,
+                double lengthSeconds)
+        : type(typeToUse)
+        , notes(notesToUse)
+        , sampleRate(sampleRateToUse)
+        , bpm(bpmToUse)
+    {
+        jassert(notes.size() > 0);
+
+        auto barLength = 4.0 * 60.0 / bpm;
+        auto bar = 0;
+
+        for (auto start = 0.0; start < lengthSeconds; start += barLength, ++bar)
+        {
+            auto end = jmin(start + barLength, lengthSeconds);
+            auto barType = type == all ? (Type) (bar % all) : type;
+
+            if (barType == blastBeat)
+                addBlastBeat(start, end);
+            else if (barType == roll)
+                addRoll(start, end);
+            else if (barType == flam)
+                addFlams(start, end);
+            else
+                addDense(start, end);
+        }
+
+        std::sort(events.begin(), events.end(),
+                  [](const Event& a, const Event& b) { return a.samplePosition < b.samplePosition; });
+    }
+
+    /*
+    * Copies the events in [startSample, startSample + numSamples)
+    * to the given buffer, with positions relative to the block start.
+    * Blocks must be requested in increasing order.
+    */
+    void fillBlock(MidiBuffer& midi, int64 startSample, int numSamples)
+    {
+        midi.clear();
+
+        auto endSample = startSample + numSamples;
+
+        while (nextEvent < events.size() && events.getReference(nextEvent).samplePosition < endSample)
+        {
+            auto& e = events.getReference(nextEvent++);
+            auto message = e.velocity > 0 ? MidiMessage::noteOn(1, e.note, (uint8) e.velocity)
+                                          : MidiMessage::noteOff(1, e.note);
+
+            midi.addEvent(message, (int) (e.samplePosition - startSample));
+        }
+    }
+
+    /*
+    * Rewinds the pattern to its first event.
+    */
+    void reset() { nextEvent = 0; }
+
+    int getNumNoteOns() const
+    {
+        auto numNoteOns = 0;
+
+        for (auto& e : events)
+            if (e.velocity > 0)
+                ++numNoteOns;
+
+        return numNoteOns;
+    }
+
+    /*
+    * Returns the largest number of events falling in a single block.
+    * Used to presize the midi buffer.
+    */
+    int getMaxEventsPerBlock(int blockSize) const
+    {
+        auto maxEvents = 0;
+
+        for (int first = 0, last = 0; first < events.size(); ++first)
+        {
+            auto blockEnd = events.getReference(first).samplePosition + blockSize;
+
+            while (last < events.size() && events.getReference(last).samplePosition < blockEnd)
+                ++last;
+
+            maxEvents = jmax(maxEvents, last - first);
+        }
+
+        return maxEvents;
+    }
+
+    static String getName(Type t)
+    {
+        switch (t)
+        {
+            case blastBeat: return "blast";
+            case roll:      return "roll";
+            case flam:      return "flam";
+            case dense:     return "dense";
+            case all:       return "all";
+            default:        break;
+        }
+
+        return {};
+    }
+
+    /*
+    * Returns the pattern type with the given name,
+    * or numTypes if the name is unknown.
+    */
+    static Type fromName(const String& name)
+    {
+        for (int t = 0; t < numTypes; ++t)
+            if (getName((Type) t) == name)
+                return (Type) t;
+
+        return numTypes;
+    }
+
+private:
+    struct Event
+    {
+        int64 samplePosition;
+        int note;
+        int velocity;
+    };
+
+    enum
+    {
+        noteLengthMs = 10,
+        flamOffsetMs = 25
+    };
+
+    void addHit(double seconds, int note, int velocity)
+    {
+        auto position = (int64) (seconds * sampleRate);
+        auto noteLength = (int64) (noteLengthMs * 0.001 * sampleRate);
+
+        events.add({ position, note, jlimit(1, 127, velocity) });
+        events.add({ position + noteLength, note, 0 });
+    }
+
+    int humanise(int velocity) { return velocity + random.nextInt(Range<int>(-8, 9)); }
+
+    /*
+    * Kick on every 16th, snare on the off 16ths,
+    * remaining pieces on quarter notes.
+    */
+    void addBlastBeat(double start, double end)
+    {
+        auto step = 60.0 / bpm / 4.0;
+        auto index = 0;
+
+        for (auto t = start; t < end; t += step, ++index)
+        {
+            addHit(t, notes[0], humanise(110));
+
+            if (notes.size() > 1 && (index % 2) == 1)
+                addHit(t, notes[1], humanise(100));
+
+            if ((index % 4) == 0)
+                for (auto i = 2; i < notes.size(); ++i)
+                    addHit(t, notes[i], humanise(90));
+        }
+    }
+
+    /*
+    * 32nd note roll moving to the next piece on every beat,
+    * with a crescendo across the bar to hit every velocity layer.
+    */
+    void addRoll(double start, double end)
+    {
+        auto step = 60.0 / bpm / 8.0;
+        auto stepsPerBar = 32;
+        auto index = 0;
+
+        for (auto t = start; t < end; t += step, ++index)
+        {
+            auto note = notes[(index / 8) % notes.size()];
+            auto velocity = 30 + (97 * (index % stepsPerBar)) / (stepsPerBar - 1);
+
+            addHit(t, note, humanise(velocity));
+        }
+    }
+
+    /*
+    * A flam on every piece at each beat:
+    * a soft grace note followed by the main stroke.
+    */
+    void addFlams(double start, double end)
+    {
+        auto step = 60.0 / bpm;
+        auto offset = flamOffsetMs * 0.001;
+
+        for (auto t = start; t < end; t += step)
+        {
+            for (auto note : notes)
+            {
+                addHit(t, note, humanise(45));
+                addHit(t + offset, note, humanise(115));
+            }
+        }
+    }
+
+    /*
+    * 64th notes on every piece, mixed with as many notes
+    * no piece is mapped to, like a busy multitimbral track.
+    */
+    void addDense(double start, double end)
+    {
+        auto step = 60.0 / bpm / 16.0;
+        auto lowestNote = notes[0];
+
+        for (auto note : notes)
+            lowestNote = jmin(lowestNote, note);
+
+        for (auto t = start; t < end; t += step)
+        {
+            for (auto i = 0; i < notes.size(); ++i)
+            {
+                addHit(t, notes[i], humanise(20 + random.nextInt(100)));
+                addHit(t, jmax(0, lowestNote - 1 - i), humanise(80));
+            }
+        }
+    }
+
+    Type type;
+    Array<int> notes;
+    Array<Event> events;
+    Random random { 1234 };
+    double sampleRate, bpm;
+    int nextEvent = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(MidiPattern)
+};
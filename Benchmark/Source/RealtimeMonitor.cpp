@@ -0,0 +1,287 @@
+#include "RealtimeMonitor.h"
+#include "../../Source/utils/RenderWorkerPool.h"
+
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX
+ #include <execinfo.h>
+ #include <pthread.h>
+ #include <dlfcn.h>
+
+ // glibc entry points behind the hooked functions
+ extern "C" void* __libc_malloc(size_t);
+ extern "C" void* __libc_calloc(size_t, size_t);
+ extern "C" void* __libc_realloc(void*, size_t);
+ extern "C" void __libc_free(void*);
+
+ #define DRUMSAMPLER_SYSTEM_MALLOC(size)   __libc_malloc(size)
+ #define DRUMSAMPLER_SYSTEM_FREE(p)        __libc_free(p)
+#else
+ #define DRUMSAMPLER_SYSTEM_MALLOC(size)   std::malloc(size)
+ #define DRUMSAMPLER_SYSTEM_FREE(p)        std::free(p)
+#endif
+
+namespace
+{
+    enum
+    {
+        maxRecords = 64,
+        maxFrames = 24,
+        framesToSkip = 2    // record() and the hook itself
+    };
+
+    struct Record
+    {
+        RealtimeMonitor::Violation violation;
+        int64 count;
+        void* frames[maxFrames];
+        int numFrames;
+    };
+
+    // Plain zero-initialised storage, usable before any constructor runs
+    Record records[maxRecords];
+    int numRecords = 0;
+    int64 numDropped = 0;
+    std::atomic<int64> counts[RealtimeMonitor::numViolations];
+    SpinLock recordsLock;
+
+    thread_local bool isWatched = false;
+    thread_local bool isRecording = false;
+
+    // Render workers render synths for the watched thread
+    void watchRenderWorker(bool isTakingTasks) { isWatched = isTakingTasks; }
+
+    int captureStack(void** frames)
+    {
+       #if JUCE_LINUX
+        return backtrace(frames, maxFrames);
+       #else
+        ignoreUnused(frames);
+        return 0;
+       #endif
+    }
+
+    // The first backtrace() loads libgcc, which allocates:
+    // do it now rather than on the audio thread
+    void* primingFrames[maxFrames];
+    const int primed = captureStack(primingFrames);
+}
+
+//==============================================================================
+RealtimeMonitor::ScopedAudioThread::ScopedAudioThread()
+{
+    isWatched = true;
+    RenderWorkerPool::setTaskHook(watchRenderWorker);
+}
+
+RealtimeMonitor::ScopedAudioThread::~ScopedAudioThread()
+{
+    RenderWorkerPool::setTaskHook(nullptr);
+    isWatched = false;
+}
+
+bool RealtimeMonitor::hooksSystemCalls()
+{
+   #if JUCE_LINUX
+    return true;
+   #else
+    return false;
+   #endif
+}
+
+void RealtimeMonitor::reset()
+{
+    const SpinLock::ScopedLockType sl(recordsLock);
+
+    for (auto& c : counts)
+        c = 0;
+
+    numRecords = 0;
+    numDropped = 0;
+}
+
+int64 RealtimeMonitor::getNumViolations()
+{
+    int64 total = 0;
+
+    for (auto& c : counts)
+        total += c.load();
+
+    return total;
+}
+
+int64 RealtimeMonitor::getNumViolations(Violation violation)
+{
+    return counts[violation].load();
+}
+
+void RealtimeMonitor::record(Violation violation)
+{
+    if (!isWatched || isRecording)
+        return;
+
+    // Anything called from here on passes through the hooks
+    isRecording = true;
+    ++counts[violation];
+
+    void* frames[maxFrames];
+    auto numFrames = captureStack(frames);
+
+    {
+        const SpinLock::ScopedLockType sl(recordsLock);
+        auto found = false;
+
+        for (auto i = 0; i < numRecords && !found; ++i)
+        {
+            auto& r = records[i];
+
+            if (r.violation == violation && r.numFrames == numFrames
+                && std::equal(frames, frames + numFrames, r.frames))
+            {
+                ++r.count;
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            if (numRecords < maxRecords)
+            {
+                auto& r = records[numRecords++];
+                r.violation = violation;
+                r.count = 1;
+                r.numFrames = numFrames;
+                std::copy(frames, frames + numFrames, r.frames);
+            }
+            else
+            {
+                ++numDropped;
+            }
+        }
+    }
+
+    isRecording = false;
+}
+
+void RealtimeMonitor::printReport()
+{
+    const SpinLock::ScopedLockType sl(recordsLock);
+
+    std::cout << "Realtime violations on the audio thread and render workers: " << getNumViolations();
+
+    for (auto v = 0; v < numViolations; ++v)
+        std::cout << (v == 0 ? " (" : ", ") << counts[v].load() << " " << getViolationName((Violation) v);
+
+    std::cout << ")" << std::endl;
+
+    if (!hooksSystemCalls())
+        std::cout << "  only operator new and delete are watched on this platform" << std::endl;
+
+    for (auto i = 0; i < numRecords; ++i)
+    {
+        auto& r = records[i];
+        std::cout << "  " << getViolationName(r.violation) << " x" << r.count << std::endl;
+
+       #if JUCE_LINUX
+        if (auto** symbols = backtrace_symbols(r.frames, r.numFrames))
+        {
+            for (auto f = jmin((int) framesToSkip, r.numFrames); f < r.numFrames; ++f)
+                std::cout << "      " << symbols[f] << std::endl;
+
+            std::free(symbols);
+        }
+       #endif
+    }
+
+    if (numDropped > 0)
+        std::cout << "  " << numDropped << " more, with stacks not recorded" << std::endl;
+}
+
+//==============================================================================
+// Replacements of the global allocation functions, used by the whole program
+void* operator new(std::size_t size)
+{
+    RealtimeMonitor::record(RealtimeMonitor::allocation);
+
+    if (auto* p = DRUMSAMPLER_SYSTEM_MALLOC(size > 0 ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    RealtimeMonitor::record(RealtimeMonitor::allocation);
+    return DRUMSAMPLER_SYSTEM_MALLOC(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p != nullptr)
+        RealtimeMonitor::record(RealtimeMonitor::deallocation);
+
+    DRUMSAMPLER_SYSTEM_FREE(p);
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+
+#if JUCE_LINUX
+// The executable's definitions take precedence over libc's,
+// so these catch JUCE's HeapBlock, std::mutex and CriticalSection too
+extern "C" void* malloc(size_t size)
+{
+    RealtimeMonitor::record(RealtimeMonitor::allocation);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t num, size_t size)
+{
+    RealtimeMonitor::record(RealtimeMonitor::allocation);
+    return __libc_calloc(num, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+    RealtimeMonitor::record(RealtimeMonitor::allocation);
+    return __libc_realloc(p, size);
+}
+
+extern "C" void free(void* p)
+{
+    if (p != nullptr)
+        RealtimeMonitor::record(RealtimeMonitor::deallocation);
+
+    __libc_free(p);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    using LockFunction = int (*)(pthread_mutex_t*);
+    static std::atomic<LockFunction> systemLock { nullptr };
+
+    // Looked up on first use, long before any thread is watched
+    auto lock = systemLock.load();
+
+    if (lock == nullptr)
+    {
+        lock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+        systemLock = lock;
+    }
+
+    RealtimeMonitor::record(RealtimeMonitor::mutexLock);
+    return lock(mutex);
+}
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Catches calls that have no place on the audio thread:
+* heap allocations and frees, and blocking mutex locks.
+*
+* A thread is watched while it's inside a ScopedAudioThread,
+* and so are render workers while they take its tasks;
+* other threads (loader, streamer) are left alone.
+* Each distinct call stack is recorded once with a count,
+* so the report points at the code to fix.
+*
+* operator new and delete are hooked everywhere. On Linux
+* malloc, calloc, realloc, free and pthread_mutex_lock are
+* hooked too, and call stacks are captured.
+*/
+class RealtimeMonitor
+{
+public:
+    enum Violation
+    {
+        allocation = 0,     // operator new, malloc, calloc, realloc
+        deallocation,       // operator delete, free
+        mutexLock,          // pthread_mutex_lock, so CriticalSection and std::mutex too
+        numViolations
+    };
+
+    static String getViolationName(Violation violation)
+    {
+        switch (violation)
+        {
+            case allocation:    return "allocation";
+            case deallocation:  return "deallocation";
+            case mutexLock:     return "mutex lock";
+            default:            return {};
+        }
+    }
+
+    /*
+    * Watches the calling thread for the lifetime of the object,
+    * and the render workers while they run tasks meanwhile.
+    */
+    struct ScopedAudioThread
+    {
+        ScopedAudioThread();
+        ~ScopedAudioThread();
+    };
+
+    /*
+    * True if the platform hooks more than operator new and delete.
+    */
+    static bool hooksSystemCalls();
+
+    static void reset();
+
+    static int64 getNumViolations();
+
+    static int64 getNumViolations(Violation violation);
+
+    /*
+    * Prints every distinct violation with its count and call stack.
+    * Must not be called from a watched thread.
+    */
+    static void printReport();
+
+    /*
+    * Called by the hooks.
+    */
+    static void record(Violation violation);
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/core/PluginProcessor.h"
+#include "MidiPatterns.h"
+#include "RealtimeMonitor.h"
+
+struct BenchmarkOptions
+{
+    double sampleRate = 44100.0;
+    double seconds = 10.0;
+    double bpm = 180.0;
+    int blockSize = 512;
+    MidiPattern::Type pattern = MidiPattern::all;
+    bool midiRouting = true;
+    bool activeVoiceList = true;
+    bool metering = true;
+    bool realtimeCheck = false;
+    int renderThreads = 1;
+    File performanceLog;            // CSV of the processor's block counters, if set
+    File kitSwap;                   // kit switched to half way through, if set
+};
+
+struct BenchmarkResults
+{
+    Array<double> blockTimes;   // microseconds, one per block
+    double totalSeconds = 0.0;
+    double renderedSeconds = 0.0;
+    int64 residentBytes = 0;
+    double loadTimeMs = 0.0;
+    double rateCopyTimeMs = 0.0;
+    int numLoaderWorkers = 0;
+    int numNoteOns = 0;
+    int peakVoices = 0;
+    double averageVoices = 0.0;
+    int64 numRealtimeViolations = 0;
+    int64 droppedNotes = 0;
+    int64 streamUnderruns = 0;
+    int64 lateBlocks = 0;
+    int kitSwapBlock = -1;          // block that switched kits, if any
+    double kitLoadTimeMs = 0.0;
+
+    /*
+    * Returns the given percentile (0 - 100) of block times.
+    */
+    double getPercentile(double percentile) const
+    {
+        if (blockTimes.isEmpty())
+            return 0.0;
+
+        Array<double> sorted(blockTimes);
+        sorted.sort();
+
+        auto index = roundToInt((percentile / 100.0) * (sorted.size() - 1));
+        return sorted[jlimit(0, sorted.size() - 1, index)];
+    }
+
+    double getRealtimeFactor() const { return totalSeconds > 0.0 ? renderedSeconds / totalSeconds : 0.0; }
+};
+
+/*
+* Runs DrumProcessor without host or editor,
+* timing every processBlock call.
+*/
+class RenderBenchmark
+{
+public:
+    enum
+    {
+        loadTimeoutMs = 10000
+    };
+
+    RenderBenchmark(const BenchmarkOptions& optionsToUse) : options(optionsToUse) { }
+
+    BenchmarkResults run()
+    {
+        BenchmarkResults results;
+        DrumProcessor processor;
+        processor.setMidiRoutingEnabled(options.midiRouting);
+        processor.setActiveVoiceListEnabled(options.activeVoiceList);
+        processor.setMeteringEnabled(options.metering);
+        processor.setNumRenderThreads(options.renderThreads);
+
+        if (options.performanceLog != File())
+            processor.getPerformanceCounters().setLogFile(options.performanceLog);
+
+        if (!waitForSamples(processor))
+            std::cout << "Warning: not all samples were loaded after " << loadTimeoutMs << " ms" << std::endl;
+
+        results.loadTimeMs = processor.getSampleLoader().getLastLoadTimeMs();
+        results.numLoaderWorkers = processor.getSampleLoader().getNumWorkers();
+
+        Array<int> notes;
+        auto kit = processor.getKit();
+
+        for (auto* s : kit->getSynths())
+            notes.add(s->getMidiNote());
+
+        MidiPattern pattern(options.pattern, notes, options.sampleRate, options.bpm, options.seconds);
+        results.numNoteOns = pattern.getNumNoteOns();
+
+        auto blockSize = options.blockSize;
+        auto numBlocks = (int) std::ceil(options.seconds * options.sampleRate / blockSize);
+
+        AudioSampleBuffer buffer(processor.getMainBusNumOutputChannels(), blockSize);
+        MidiBuffer midi;
+        midi.ensureSize((size_t) pattern.getMaxEventsPerBlock(blockSize) * 4 * sizeof(MidiMessage));
+
+        prepare(processor);
+        results.blockTimes.ensureStorageAllocated(numBlocks);
+
+        // Host rate copies of the samples are made in background too
+        if (!waitForSamples(processor))
+            std::cout << "Warning: sample rate copies not ready after " << loadTimeoutMs << " ms" << std::endl;
+
+        results.rateCopyTimeMs = processor.getSampleLoader().getLastLoadTimeMs();
+
+        for (auto* s : kit->getSynths())
+            results.residentBytes += s->getResidentBytes();
+
+        RealtimeMonitor::reset();
+
+        for (auto block = 0; block < numBlocks; ++block)
+        {
+            pattern.fillBlock(midi, (int64) block * blockSize, blockSize);
+
+            // Loaded off the clock, as a host would keep playing meanwhile:
+            // what counts is the block that takes the new kit over
+            if (options.kitSwap != File() && block == numBlocks / 2)
+                loadKit(processor, results);
+
+            auto start = Time::getHighResolutionTicks();
+
+            if (options.realtimeCheck)
+            {
+                RealtimeMonitor::ScopedAudioThread audioThread;
+                processor.processBlock(buffer, midi);
+            }
+            else
+            {
+                processor.processBlock(buffer, midi);
+            }
+
+            auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+            results.blockTimes.add(elapsed * 1.0e6);
+            results.totalSeconds += elapsed;
+            auto numVoices = countActiveVoices(processor);
+            results.peakVoices = jmax(results.peakVoices, numVoices);
+            results.averageVoices += numVoices;
+        }
+
+        results.averageVoices /= jmax(1, numBlocks);
+        results.numRealtimeViolations = RealtimeMonitor::getNumViolations();
+
+        results.renderedSeconds = numBlocks * blockSize / options.sampleRate;
+        processor.releaseResources();
+
+        // Takes what's left in the ring before reading totals
+        auto& counters = processor.getPerformanceCounters();
+        counters.stop();
+        results.droppedNotes = counters.getSummary().droppedNotes;
+        results.streamUnderruns = counters.getSummary().streamUnderruns;
+        results.lateBlocks = counters.getSummary().numOverruns;
+
+        return results;
+    }
+
+    void printResults(const BenchmarkResults& results) const
+    {
+        auto deadline = 1.0e6 * options.blockSize / options.sampleRate;
+
+        std::cout << "DrumSampler render benchmark" << std::endl
+                  << "  pattern:         " << MidiPattern::getName(options.pattern) << std::endl
+                  << "  sample rate:     " << options.sampleRate << " Hz" << std::endl
+                  << "  block size:      " << options.blockSize << std::endl
+                  << "  midi routing:    " << (options.midiRouting ? "note table" : "full buffer per synth") << std::endl
+                  << "  voice list:      " << (options.activeVoiceList ? "active voices" : "every voice") << std::endl
+                  << "  meters:          " << (options.metering ? "on" : "off") << std::endl
+                  << "  render threads:  " << options.renderThreads << std::endl
+                  << "  rendered:        " << results.renderedSeconds << " s ("
+                  << results.blockTimes.size() << " blocks, " << results.numNoteOns << " note-ons)" << std::endl
+                  << "  block time (us): p50 " << results.getPercentile(50.0)
+                  << ", p90 " << results.getPercentile(90.0)
+                  << ", p99 " << results.getPercentile(99.0)
+                  << ", max " << results.getPercentile(100.0)
+                  << " (deadline " << deadline << ")" << std::endl
+                  << "  realtime factor: " << results.getRealtimeFactor() << "x" << std::endl
+                  << "  voices:          peak " << results.peakVoices << ", average " << results.averageVoices
+                  << " (" << (results.averageVoices > 0.0 ? results.getPercentile(50.0) / results.averageVoices : 0.0)
+                  << " us per voice at p50)" << std::endl
+                  << "  counters:        " << results.droppedNotes << " dropped note-ons, "
+                  << results.streamUnderruns << " stream underruns, "
+                  << results.lateBlocks << " blocks over deadline" << std::endl
+                  << "  sample memory:   " << File::descriptionOfSizeInBytes(results.residentBytes) << std::endl
+                  << "  sample loading:  " << results.loadTimeMs << " ms ("
+                  << results.numLoaderWorkers << " workers)" << std::endl
+                  << "  rate copies:     " << results.rateCopyTimeMs << " ms" << std::endl;
+
+        if (results.kitSwapBlock >= 0)
+            std::cout << "  kit switch:      loaded in " << results.kitLoadTimeMs << " ms, switching block took "
+                      << results.blockTimes[results.kitSwapBlock] << " us" << std::endl;
+
+        if (options.realtimeCheck)
+            RealtimeMonitor::printReport();
+    }
+
+private:
+    /*
+    * Samples are read by the loader in background,
+    * so wait until its queue is empty before rendering.
+    */
+    bool waitForSamples(DrumProcessor& processor)
+    {
+        return processor.getSampleLoader().waitUntilIdle(loadTimeoutMs);
+    }
+
+    void prepare(DrumProcessor& processor)
+    {
+        processor.setRateAndBufferSizeDetails(options.sampleRate, options.blockSize);
+        processor.prepareToPlay(options.sampleRate, options.blockSize);
+    }
+
+    static int countActiveVoices(DrumProcessor& processor)
+    {
+        auto numActive = 0;
+        auto kit = processor.getKit();
+
+        for (auto* s : kit->getSynths())
+            numActive += s->getNumActiveVoices();
+
+        return numActive;
+    }
+
+    void loadKit(DrumProcessor& processor, BenchmarkResults& results)
+    {
+        auto start = Time::getMillisecondCounterHiRes();
+        processor.loadKit(options.kitSwap);
+
+        while (processor.isKitLoading() && Time::getMillisecondCounterHiRes() - start < loadTimeoutMs)
+            Thread::sleep(5);
+
+        results.kitLoadTimeMs = Time::getMillisecondCounterHiRes() - start;
+
+        if (processor.getKit()->getFile() == options.kitSwap)
+            results.kitSwapBlock = results.blockTimes.size();
+        else
+            std::cout << "Warning: kit " << options.kitSwap.getFullPathName() << " not loaded" << std::endl;
+    }
+
+    BenchmarkOptions options;
+};
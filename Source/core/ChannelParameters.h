@@ -0,0 +1,112 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Parameters of one channel as its voices see them during a block.
+* Gains already include level, pan and mute, and are given
+* at both ends of the block so voices ramp between them.
+*/
+struct ChannelSnapshot
+{
+    /*
+    * Returns the gain of the given output channel
+    * at a sample of the block, 0 being its first.
+    */
+    float getGain(int channel, int sampleInBlock) const
+    {
+        if (numSamples <= 0)
+            return endGain[channel];
+
+        auto alpha = jlimit(0.0f, 1.0f, (float) sampleInBlock / (float) numSamples);
+        return startGain[channel] + (endGain[channel] - startGain[channel]) * alpha;
+    }
+
+    float startGain[2] = { 1.0f, 1.0f };
+    float endGain[2] = { 1.0f, 1.0f };
+    int numSamples = 0;
+    float coarse = 0.0f;
+    float fine = 0.0f;
+    int quality = 0;
+};
+
+/*
+* Reads the parameters of a channel once per block into a
+* ChannelSnapshot, so its voices never touch the parameter
+* atomics and all of them play the block with the same values.
+* Level and pan are smoothed, so automating them doesn't click.
+*/
+class ChannelParameters
+{
+public:
+    ChannelParameters(AudioProcessorValueTreeState& vts, const String& channelName)
+    {
+        level = vts.getRawParameterValue("p" + channelName + "Level");
+        pan = vts.getRawParameterValue("p" + channelName + "Pan");
+        coarse = vts.getRawParameterValue("p" + channelName + "Coarse");
+        fine = vts.getRawParameterValue("p" + channelName + "Fine");
+        quality = vts.getRawParameterValue("p" + channelName + "Quality");
+
+        jassert(level != nullptr && pan != nullptr && coarse != nullptr && fine != nullptr && quality != nullptr);
+    }
+
+    /*
+    * Sets the smoothing time for the given rate
+    * and jumps to the current values.
+    */
+    void prepare(double sampleRate)
+    {
+        smoothedLevel.reset(sampleRate, rampSeconds);
+        smoothedPan.reset(sampleRate, rampSeconds);
+        smoothedLevel.setCurrentAndTargetValue(level->load());
+        smoothedPan.setCurrentAndTargetValue(pan->load());
+    }
+
+    /*
+    * Fills the snapshot for the next block of numSamples.
+    * A channel that isn't audible fades to silence.
+    * Called from the audio thread before rendering the block.
+    */
+    const ChannelSnapshot& update(int numSamples, bool audible)
+    {
+        smoothedLevel.setTargetValue(audible ? level->load() : 0.0f);
+        smoothedPan.setTargetValue(pan->load());
+
+        getGains(snapshot.startGain);
+        smoothedLevel.skip(numSamples);
+        smoothedPan.skip(numSamples);
+        getGains(snapshot.endGain);
+
+        snapshot.numSamples = numSamples;
+        snapshot.coarse = coarse->load();
+        snapshot.fine = fine->load();
+        snapshot.quality = (int) quality->load();
+
+        return snapshot;
+    }
+
+    const ChannelSnapshot& getSnapshot() const { return snapshot; }
+
+private:
+    static constexpr double rampSeconds = 0.02;
+
+    void getGains(float* gains) const
+    {
+        auto curLevel = smoothedLevel.getCurrentValue();
+        auto curPan = smoothedPan.getCurrentValue();
+
+        gains[0] = curLevel * jmin(1.0f - curPan, 1.0f);
+        gains[1] = curLevel * jmin(1.0f + curPan, 1.0f);
+    }
+
+    std::atomic<float>* level = nullptr;
+    std::atomic<float>* pan = nullptr;
+    std::atomic<float>* coarse = nullptr;
+    std::atomic<float>* fine = nullptr;
+    std::atomic<float>* quality = nullptr;
+
+    SmoothedValue<float, ValueSmoothingTypes::Linear> smoothedLevel, smoothedPan;
+    ChannelSnapshot snapshot;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelParameters)
+};
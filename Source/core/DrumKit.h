@@ -0,0 +1,303 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DrumSynth.h"
+#include "../utils/DrumsetXmlHandler.h"
+#include "../utils/SampleLoader.h"
+#include "../utils/ReleaseQueue.h"
+
+/*
+* Everything the audio thread plays for one kit: a synth per
+* channel, with its samples, midi note and choke targets.
+*
+* A kit is built and loaded away from the audio thread, then
+* handed over whole, so switching kits never stalls a block.
+* Channel i of a kit follows the parameters and output of slot i,
+* the channels mixer_info.xml declared when the plugin was created,
+* as hosts can't take new parameters or buses while running.
+*/
+class DrumKit : public ReleaseQueue::Retirable
+{
+public:
+    typedef ReferenceCountedObjectPtr<DrumKit> Ptr;
+
+    enum
+    {
+        maxChannels = 32,
+        firstNote = 72          // note of channel 0 without a note attribute
+    };
+
+    /*
+    * Builds the kit described by the given file, one synth per
+    * channel up to the number of slots, and queues its samples
+    * on the loader. The kit can be played once isLoaded().
+    */
+    DrumKit(const File& kitFile,
+            const StringArray& slots,
+            AudioProcessorValueTreeState& vts,
+            SampleStreamer& streamer,
+            SampleLoader& loader,
+            ReleaseQueue& releaseQueue)
+        : file(kitFile)
+    {
+        DrumsetXmlHandler kitInfo(kitFile);
+        name = kitInfo.getKitName();
+        channelNames = kitInfo.getActiveOutputs();
+
+        // Channels past the last slot have nowhere to play
+        jassert(channelNames.size() <= slots.size());
+        channelNames.removeRange(jmin(slots.size(), (int) maxChannels), channelNames.size());
+
+        for (auto i = 0; i < channelNames.size(); i++)
+        {
+            auto& channelName = channelNames.getReference(i);
+            auto* synth = synths.add(new DrumSynth(vts, slots[i], channelName, kitInfo.getSampleFolder(),
+                                                   kitInfo.getMidiNote(channelName, firstNote + i),
+                                                   kitInfo.getRoundRobins(channelName),
+                                                   streamer, kitInfo.getStreamingOptions(), loader, releaseQueue));
+
+            synth->setStealingPolicy(VoicePool::getPolicyFromName(kitInfo.getVoiceStealing(channelName), VoicePool::oldest));
+            synth->setRoundRobinMode(RoundRobin::getModeFromName(kitInfo.getRoundRobinMode(channelName), RoundRobin::cycle));
+            synth->attachMidiLearn(vts.getRawParameterValue("p" + slots[i] + "Learn"));
+        }
+
+        buildChokeTargets(kitInfo);
+    }
+
+    const File& getFile() const { return file; }
+
+    const String& getName() const { return name; }
+
+    int getNumChannels() const { return synths.size(); }
+
+    DrumSynth* getSynth(int channel) const { return synths.getUnchecked(channel); }
+
+    const OwnedArray<DrumSynth>& getSynths() const { return synths; }
+
+    /*
+    * Returns true once every sample of the kit has been read.
+    */
+    bool isLoaded() const
+    {
+        for (auto* synth : synths)
+            if (!synth->isLoaded())
+                return false;
+
+        return true;
+    }
+
+    /*
+    * Sets up the synths for the given rate and, if the rate
+    * changed, queues copies of the samples at that rate.
+    * Never called while the audio thread plays this kit.
+    */
+    void prepare(double sampleRate)
+    {
+        for (auto* synth : synths)
+        {
+            synth->setCurrentPlaybackSampleRate(sampleRate);
+            synth->getChannelParameters().prepare(sampleRate);
+
+            if (sampleRate != preparedSampleRate)
+                synth->prepareSounds(sampleRate);
+        }
+
+        preparedSampleRate = sampleRate;
+    }
+
+    double getPreparedSampleRate() const { return preparedSampleRate; }
+
+    void setActiveListEnabled(bool shouldBeEnabled)
+    {
+        for (auto* synth : synths)
+            synth->setActiveListEnabled(shouldBeEnabled);
+    }
+
+    /*
+    * Returns the channels a note of the given channel chokes,
+    * with bit j set for channel j.
+    */
+    uint32 getChokeTargets(int channel) const { return chokeTargets[channel]; }
+
+    bool hasChokes() const { return anyChokes; }
+
+    /*
+    * Chokes every playing voice from the start of the next
+    * block, so the kit fades out over a few milliseconds.
+    * Called from the audio thread.
+    */
+    void fadeOut()
+    {
+        for (auto* synth : synths)
+            synth->addChoke(0);
+    }
+
+    /*
+    * Returns true while any voice of the kit is playing.
+    * Called from the audio thread.
+    */
+    bool isPlaying()
+    {
+        for (auto* synth : synths)
+            if (synth->getNumActiveVoices() > 0)
+                return true;
+
+        return false;
+    }
+
+private:
+    /*
+    * Fills chokeTargets from the chokeGroup and
+    * chokes attributes of each channel.
+    */
+    void buildChokeTargets(const DrumsetXmlHandler& kitInfo)
+    {
+        for (auto i = 0; i < channelNames.size(); i++)
+        {
+            auto chokedGroups = kitInfo.getChokedGroups(channelNames[i]);
+
+            for (auto j = 0; j < channelNames.size(); j++)
+            {
+                auto group = kitInfo.getChokeGroup(channelNames[j]);
+
+                if (group > 0 && (chokedGroups & (1u << (group - 1))) != 0)
+                    chokeTargets[i] |= (1u << j);
+            }
+
+            anyChokes = anyChokes || chokeTargets[i] != 0;
+        }
+    }
+
+    File file;
+    String name;
+    StringArray channelNames;
+    OwnedArray<DrumSynth> synths;
+    double preparedSampleRate = 0.0;
+
+    // Bit j of chokeTargets[i] is set if a note of channel i chokes channel j
+    uint32 chokeTargets[maxChannels] = {};
+    bool anyChokes = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumKit)
+};
+
+/*
+* Builds kits on a background thread and hands each one over
+* once all its samples are in memory. A newer request abandons
+* the kit still loading, so only the last one asked for is published.
+*/
+class KitLoader : private Thread
+{
+public:
+    enum
+    {
+        pollIntervalMs = 10
+    };
+
+    /*
+    * build makes the kit of a file, or returns nullptr if it can't;
+    * publish receives it once loaded. Both run on the loader thread.
+    */
+    KitLoader(std::function<DrumKit::Ptr(const File&)> buildFunction,
+              std::function<void(DrumKit::Ptr)> publishFunction)
+        : Thread("DrumSampler Kit Loader")
+        , build(std::move(buildFunction))
+        , publish(std::move(publishFunction))
+    { }
+
+    ~KitLoader()
+    {
+        stop();
+    }
+
+    /*
+    * Starts building the kit of the given file in background.
+    */
+    void load(const File& kitFile)
+    {
+        {
+            const ScopedLock sl(lock);
+            requestedFile = kitFile;
+            hasRequest = true;
+            ++numRequests;
+        }
+
+        if (!isThreadRunning())
+            startThread(3);
+
+        notify();
+    }
+
+    /*
+    * Returns true from a request until its kit is published or dropped.
+    */
+    bool isLoading() const { return numFinished.load() != numRequests.load(); }
+
+    /*
+    * Stops the thread, dropping the kit being loaded.
+    */
+    void stop()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(4000);
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            File kitFile;
+            int requestNumber = 0;
+
+            if (!takeRequest(kitFile, requestNumber))
+            {
+                wait(-1);
+                continue;
+            }
+
+            auto kit = build(kitFile);
+
+            while (kit != nullptr && !kit->isLoaded() && !threadShouldExit() && !hasPendingRequest())
+                wait(pollIntervalMs);
+
+            if (kit != nullptr && kit->isLoaded() && !threadShouldExit() && !hasPendingRequest())
+                publish(kit);
+
+            numFinished = requestNumber;
+        }
+    }
+
+    bool takeRequest(File& kitFile, int& requestNumber)
+    {
+        const ScopedLock sl(lock);
+
+        if (!hasRequest)
+            return false;
+
+        kitFile = requestedFile;
+        requestNumber = numRequests.load();
+        hasRequest = false;
+        return true;
+    }
+
+    bool hasPendingRequest() const
+    {
+        const ScopedLock sl(lock);
+        return hasRequest;
+    }
+
+    std::function<DrumKit::Ptr(const File&)> build;
+    std::function<void(DrumKit::Ptr)> publish;
+
+    CriticalSection lock;
+    File requestedFile;
+    bool hasRequest = false;
+
+    // Requests made and handled, counted so a late one isn't missed
+    std::atomic<int> numRequests { 0 };
+    std::atomic<int> numFinished { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(KitLoader)
+};
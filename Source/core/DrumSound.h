@@ -5,31 +5,97 @@
 #include "PluginProcessor.h"
 #include "DrumSynth.h"
 #include "../utils/ReferenceCountedBuffer.h"
+#include "../utils/DrumsetXmlHandler.h"
+#include "../utils/SampleStreamer.h"
+#include "../utils/SampleCache.h"
+#include "../utils/ResampledSample.h"
+#include "../utils/ReleaseQueue.h"
+#include "../dsp/VoiceRenderKernel.h"
+#include "ChannelParameters.h"
 
 class DrumSound
     : public SynthesiserSound
-    , private Thread
+    , public StreamSource
 {
 public:
     enum
     {
         midiRootNote = 60,
-        maxSampleLengthSeconds = 30
+        maxSampleLengthSeconds = 30,
+        envelopeWindowsPerSecond = 100
     };
 
-    DrumSound() : Thread("DrumSound Thread")
+    DrumSound(const StreamingOptions& streamingOptions)
+        : streaming(streamingOptions)
     {
         formatManager.registerBasicFormats();
-        startThread();
     }
 
     ~DrumSound()
+    { }
+
+    /*
+    * Reads this sound's sample from disk.
+    * Called by a SampleLoader worker once name, index
+    * and velocity range have been set.
+    * Maps the decoded sample cache, rebuilding it if missing or
+    * stale, and only decodes the file if the cache can't be used.
+    */
+    void load()
+    {
+        setPath();
+
+        File file(path);
+        auto cached = SampleCache::open(file);
+
+        if (cached == nullptr && SampleCache::rebuild(file, formatManager))
+            cached = SampleCache::open(file);
+
+        if (cached != nullptr)
+            readFromCache(std::move(cached), file.getFileName());
+        else
+            readFromPath(path);
+
+        computeEnvelope();
+
+        const ScopedLock sl(variantLock);
+        loaded = true;
+        updateHostRateCopy();
+    }
+
+    /*
+    * Makes a copy of the sample at the host rate, if it differs
+    * from the file's. Called by a SampleLoader worker on prepareToPlay;
+    * if the sample isn't loaded yet, load() makes the copy instead.
+    */
+    void prepareForRate(double sampleRate)
     {
-        stopThread(4000);
+        const ScopedLock sl(variantLock);
+        hostRate = sampleRate;
+
+        if (loaded)
+            updateHostRateCopy();
+    }
+
+    /*
+    * Returns the copy of the sample at the given rate,
+    * or nullptr if voices have to resample the original.
+    * Safe to call from the audio thread.
+    */
+    ResampledSample::Ptr getHostRateCopy(double sampleRate) const
+    {
+        auto* copy = hostRateCopy.load();
+
+        if (copy != nullptr && copy->getSampleRate() == sampleRate)
+            return copy;
+
+        return nullptr;
     }
 
     void setName(String name) { chName = name; };
 
+    void setSampleFolder(const File& folder) { sampleFolder = folder; }
+
     void setIndex(int i) { index = i; }
 
     void setVelocityRange(Range<float> range)
@@ -65,37 +131,78 @@ public:
 
     bool appliesToChannel(int midiChannel) override { return true; }
 
-    std::unique_ptr<AudioFormatReader> reader;
-    ReferenceCountedBuffer::Ptr buffer;
-    int lenght = 0;
-
+    /*
+    * Returns true if only the head of the sample is in memory
+    * and voices have to stream the rest from disk.
+    */
+    bool isStreamed() const { return streamed; }
 
-private:
     /*
-    * Handles thread execution inside a continous loop.
+    * Returns the memory used by the loaded sample data,
+    * including the host rate copy.
     */
-    void run()
+    int64 getResidentBytes() const
+    {
+        ReferenceCountedBuffer::Ptr retained(buffer);
+        if (retained == nullptr)
+            return 0;
+
+        auto* data = retained->getAudioSampleBuffer();
+        auto numBytes = (int64) data->getNumChannels() * data->getNumSamples() * (int64) sizeof(float);
+
+        if (auto* copy = hostRateCopy.load())
+            numBytes += copy->getResidentBytes();
+
+        return numBytes;
+    }
+
+    //==============================================================================
+    void readStreamSamples(AudioBuffer<float>& dest, int destStart, int64 sourceStart, int numSamples) override
     {
-        while (!threadShouldExit())
+        if (mappedChannels[0] == nullptr)
         {
-            if (!isPathSet)
-            {
-                setPath();
-                readFromPath(path);
-                isPathSet = true;
-            }
-            wait(500);
+            reader->read(&dest, destStart, numSamples, sourceStart, true, true);
+            return;
         }
+
+        // Same as the reader: mono samples fill both channels
+        for (auto ch = 0; ch < dest.getNumChannels(); ++ch)
+            dest.copyFrom(ch, destStart, mappedChannels[jmin(ch, numMappedChannels - 1)] + sourceStart, numSamples);
     }
 
+    int64 getStreamLength() const override { return lenght; }
+
+    /*
+    * Returns the peak level of the sample around the given time,
+    * as a cheap estimate of how loud a voice playing it is.
+    * Past the resident part the last known level is returned.
+    */
+    float getEnvelope(double seconds) const
+    {
+        auto numWindows = numEnvelopeWindows.load(std::memory_order_acquire);
+
+        if (numWindows == 0)
+            return 1.0f;
+
+        auto window = jlimit(0, numWindows - 1, (int) (seconds * envelopeWindowsPerSecond));
+        return envelope[window];
+    }
+
+    std::unique_ptr<AudioFormatReader> reader;
+    ReferenceCountedBuffer::Ptr buffer;
+    double sourceSampleRate = 0.0;
+    int lenght = 0;
+
+
+private:
     /*
     * Sets the reference path for this sound.
     */
     void setPath()
     {
         String msg;
-        auto parentDir = workingDirectory.getCurrentWorkingDirectory();
-        auto dir = parentDir.getChildFile("../../../../../Resources/Samples");
+        path.clear();
+        auto dir = sampleFolder;
 
         // Formato nome file: PieceName_index_velocity.aif
         // velocity: the lowest value of the range
@@ -111,7 +218,9 @@ private:
 
 
     /*
-    * Reads a file from given path and loads it to a local AudioBuffer<float>
+    * Reads a file from given path and loads it to a local AudioBuffer<float>.
+    * When streaming is enabled only the first preloadSamples are loaded,
+    * the reader stays open to stream the rest.
     */
     void readFromPath(String pathToOpen)
     {
@@ -125,16 +234,20 @@ private:
                 if (reader->sampleRate > 0 && reader->lengthInSamples > 0)
                 {
                     lenght = (int) reader->lengthInSamples;
+                    sourceSampleRate = reader->sampleRate;
                     auto duration = (float) reader->lengthInSamples / reader->sampleRate;
 
-                    if (duration < maxSampleLengthSeconds)
+                    streamed = streaming.enabled && lenght > streaming.preloadSamples;
+                    auto numToLoad = streamed ? streaming.preloadSamples : lenght;
+
+                    if (streamed || duration < maxSampleLengthSeconds)
                     {
                         ReferenceCountedBuffer::Ptr newBuffer = new ReferenceCountedBuffer (file.getFileName(),
                                                                                         (int) reader->numChannels,
-                                                                                        (int) reader->lengthInSamples);
+                                                                                        numToLoad);
                         reader->read(newBuffer->getAudioSampleBuffer(),
                                      0,
-                                     lenght,
+                                     numToLoad,
                                      0,
                                      true,
                                      true);
@@ -155,16 +268,164 @@ private:
         }
     }
 
+    /*
+    * Uses the memory-mapped cache as sample buffer.
+    * When streaming, the buffer only spans the head of the mapping
+    * and the streamer copies the rest straight from the mapped pages.
+    * Same length limit as readFromPath for samples not streamed.
+    */
+    void readFromCache(std::unique_ptr<SampleCache::MappedSample> cached, const String& name)
+    {
+        lenght = (int) jmin(cached->numSamples, (int64) std::numeric_limits<int>::max());
+        sourceSampleRate = cached->sampleRate;
+
+        streamed = streaming.enabled && lenght > streaming.preloadSamples;
+        auto numResident = streamed ? streaming.preloadSamples : lenght;
+        auto duration = (float) lenght / sourceSampleRate;
+
+        if (!streamed && duration >= maxSampleLengthSeconds)
+        {
+            jassertfalse; // cannot add files longer than maxSampleLengthSeconds
+            return;
+        }
+
+        numMappedChannels = jmin(cached->numChannels, 2);
+
+        for (auto ch = 0; ch < numMappedChannels; ++ch)
+        {
+            mappedChannels[ch] = cached->channels[ch];
+            SampleCache::prefault(mappedChannels[ch], numResident);
+        }
+
+        buffer = new ReferenceCountedBuffer(name,
+                                            std::move(cached->file),
+                                            cached->channels,
+                                            numMappedChannels,
+                                            numResident);
+    }
+
+    /*
+    * Builds the copy for the current host rate and publishes it
+    * to the voices. Must be called with variantLock held.
+    */
+    void updateHostRateCopy()
+    {
+        auto* current = hostRateCopy.load();
+
+        if (hostRate <= 0.0 || sourceSampleRate <= 0.0 || hostRate == sourceSampleRate)
+        {
+            hostRateCopy = nullptr;
+        }
+        else if (current == nullptr || current->getSampleRate() != hostRate)
+        {
+            ResampledSample::Ptr copy;
+
+            for (auto* c : hostRateCopies)
+                if (c->getSampleRate() == hostRate)
+                    copy = c;
+
+            if (copy == nullptr)
+                copy = createHostRateCopy();
+
+            if (copy != nullptr)
+                hostRateCopies.addIfNotAlreadyThere(copy.get());
+
+            hostRateCopy = copy.get();
+        }
+
+        // Replaced copies are kept until the sound goes: the audio
+        // thread may have just read the raw pointer and not yet
+        // taken its reference, so no reference count tells when
+        // one is safe to free. There is one per host rate used.
+    }
+
+    ResampledSample::Ptr createHostRateCopy()
+    {
+        File file(path);
+        const float* channels[2] = {};
+        AudioBuffer<float> decoded;
+        auto numChannels = numMappedChannels;
+
+        if (numChannels > 0)
+        {
+            for (auto ch = 0; ch < numChannels; ++ch)
+                channels[ch] = mappedChannels[ch];
+        }
+        else
+        {
+            // No cache to read from: decode the whole file again,
+            // with a reader of its own as the streamer may be using ours
+            std::unique_ptr<AudioFormatReader> fileReader(formatManager.createReaderFor(file));
+
+            if (fileReader == nullptr)
+                return nullptr;
+
+            numChannels = jmin((int) fileReader->numChannels, 2);
+            decoded.setSize(numChannels, lenght);
+            fileReader->read(&decoded, 0, lenght, 0, true, numChannels > 1);
+
+            for (auto ch = 0; ch < numChannels; ++ch)
+                channels[ch] = decoded.getReadPointer(ch);
+        }
+
+        return ResampledSample::create(file, channels, numChannels, lenght, sourceSampleRate, hostRate, streaming);
+    }
+
+    /*
+    * Stores the peak of every envelope window of the resident data.
+    */
+    void computeEnvelope()
+    {
+        ReferenceCountedBuffer::Ptr retained(buffer);
+
+        if (retained == nullptr || sourceSampleRate <= 0.0)
+            return;
+
+        auto* data = retained->getAudioSampleBuffer();
+        auto windowSize = jmax(1, roundToInt(sourceSampleRate / envelopeWindowsPerSecond));
+        auto numWindows = (data->getNumSamples() + windowSize - 1) / windowSize;
+
+        envelope.allocate((size_t) jmax(1, numWindows), true);
+
+        for (auto w = 0; w < numWindows; ++w)
+        {
+            auto start = w * windowSize;
+            auto num = jmin(windowSize, data->getNumSamples() - start);
+
+            for (auto ch = 0; ch < data->getNumChannels(); ++ch)
+                envelope[w] = jmax(envelope[w], data->getMagnitude(ch, start, num));
+        }
+
+        numEnvelopeWindows.store(numWindows, std::memory_order_release);
+    }
+
     friend class DrumVoice;
 
     AudioFormatManager formatManager;
-    File workingDirectory;
+    StreamingOptions streaming;
     BigInteger midiNotes;
     Range<float> velocity;
     String path, chName;
+    File sampleFolder { DrumsetXmlHandler::getProjectRoot().getChildFile("Resources/Samples") };
     int index = 0;
     int playingMidiNote = 0;
-    bool isPathSet = false;
+    bool streamed = false;
+
+    // Planes of the mapped cache, kept alive by buffer
+    const float* mappedChannels[2] = {};
+    int numMappedChannels = 0;
+
+    // Peak level every 1 / envelopeWindowsPerSecond seconds
+    HeapBlock<float> envelope;
+    std::atomic<int> numEnvelopeWindows { 0 };
+
+    // Copies at the host rate, built by loader workers
+    // and kept for the life of the sound
+    CriticalSection variantLock;
+    ReferenceCountedArray<ResampledSample> hostRateCopies;
+    std::atomic<ResampledSample*> hostRateCopy { nullptr };
+    double hostRate = 0.0;
+    bool loaded = false;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumSound)
 };
@@ -174,7 +435,10 @@ private:
 class DrumVoice : public SynthesiserVoice
 {
 public:
-    DrumVoice() { }
+    DrumVoice(const ChannelSnapshot& channelSnapshot, ReleaseQueue& queue)
+        : channel(channelSnapshot)
+        , releaseQueue(queue)
+    { }
 
     ~DrumVoice() { }
 
@@ -191,13 +455,42 @@ public:
     */
     void startNote(int /*midiNoteNumber*/, float velocity, SynthesiserSound* s, int /*currentPitchWheelPosition*/) override
     {
-        if (auto* sound = dynamic_cast<const DrumSound*> (s))
+        if (auto* sound = dynamic_cast<DrumSound*> (s))
         {
-            semitones = *coarse;
-            cents = *fine;
+            semitones = channel.coarse;
+            cents = channel.fine;
             sourceSamplePosition = 0.0;
+            chokePosition = -1;
+            fadeRemaining = 0;
+
+            // The last note's source stops streaming before it's retired
+            if (stream != nullptr)
+                stream->stop();
+
+            releaseSample();
+
+            // Prefer the copy at the host rate: unpitched,
+            // it plays at unity and skips interpolation
+            playingCopy = sound->getHostRateCopy(getSampleRate());
+            playingBuffer = playingCopy != nullptr ? playingCopy->getBuffer() : sound->buffer;
+            playingSampleRate = playingCopy != nullptr ? playingCopy->getSampleRate() : sound->sourceSampleRate;
+
             pitchRatio = std::pow(2.0, (semitones + cents * 0.01) / 12.0)
-                * sound->reader->sampleRate / getSampleRate();
+                * playingSampleRate / getSampleRate();
+
+            interpolator = VoiceRenderKernel::Interpolator((VoiceRenderKernel::Interpolation) channel.quality,
+                                                           pitchRatio, *sincTable);
+
+            // Stream what comes after the preloaded head, overlapping
+            // it by the widest interpolation reach across the boundary
+            if (stream != nullptr && playingBuffer != nullptr && isPlayingStreamed(sound))
+            {
+                auto* head = playingBuffer.get();
+                auto overlap = (int) VoiceRenderKernel::maxTapsBefore + (int) VoiceRenderKernel::maxTapsAfter;
+                auto* source = playingCopy != nullptr ? static_cast<StreamSource*> (playingCopy.get()) : sound;
+
+                stream->start(source, jmax(0, head->getAudioSampleBuffer()->getNumSamples() - overlap));
+            }
         }
         else
         {
@@ -213,80 +506,92 @@ public:
     void stopNote(float velocity, bool allowTailOff) override
     {
         ignoreUnused(velocity, allowTailOff);
+
+        if (stream != nullptr)
+            stream->stop();
+
+        releaseSample();
         clearCurrentNote();
     }
 
     /*
     * Renders the current sample block for this synth.
+    * A choked note plays at full level up to the choke,
+    * then fades out and stops.
     * Overrides juce:Synthesiser method
     */
     void renderNextBlock(AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
     {
-        if (auto* playingSound = static_cast<DrumSound*> (getCurrentlyPlayingSound().get()))
+        if (getCurrentlyPlayingSound() == nullptr)
+            return;
+
+        // Note started within this block: leave its first samples alone
+        auto numToSkip = jlimit(0, numSamples, startPosition - startSample);
+        startSample += numToSkip;
+        numSamples -= numToSkip;
+        startPosition = 0;
+
+        if (chokePosition >= 0)
         {
-            ReferenceCountedBuffer::Ptr retainedCurrentBuffer (playingSound->buffer);
+            auto numBeforeChoke = jlimit(0, numSamples, chokePosition - startSample);
+            chokePosition = -1;
+            fadeRemaining = fadeLength;
 
-            if (retainedCurrentBuffer == nullptr)
-            {
-                outputBuffer.clear();
-                return;
-            }
+            renderSegment(outputBuffer, startSample, numBeforeChoke, 1.0f, 1.0f);
+            startSample += numBeforeChoke;
+            numSamples -= numBeforeChoke;
+        }
 
-            auto& data = *retainedCurrentBuffer->getAudioSampleBuffer();
-            isMuteEnabled = *muteEnabled > 0.5f ? true : false;
-            auto curPan = pan->load();
-            auto curGain = isMuteEnabled ? 0.0f : level->load();
+        if (fadeRemaining > 0)
+        {
+            auto numFade = jmin(numSamples, fadeRemaining);
+            auto fadeStart = (float) fadeRemaining / (float) fadeLength;
+            fadeRemaining -= numFade;
 
-            const float* const inL = data.getReadPointer(0);
-            const float* const inR = data.getNumChannels() > 1 ? data.getReadPointer(1) : nullptr;
+            renderSegment(outputBuffer, startSample, numFade, fadeStart, (float) fadeRemaining / (float) fadeLength);
 
-            float* outL = outputBuffer.getWritePointer(0, startSample);
-            float* outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
+            // Faded out: the synth gives the voice back to the pool after this block
+            if (fadeRemaining == 0 && isVoiceActive())
+                stopNote(0.0f, false);
 
-            // Fill buffer with samples
-            while (--numSamples >= 0)
-            {
-                auto pos = (int) sourceSamplePosition;
-                auto alpha = (float) (sourceSamplePosition - pos);
-                auto invAlpha = 1.0f - alpha;
+            return;
+        }
 
-                // just using a very simple linear interpolation here..
-                float l = (inL[pos] * invAlpha + inL[pos + 1] * alpha);
-                float r = (inR != nullptr) ? (inR[pos] * invAlpha + inR[pos + 1] * alpha) : l;
+        renderSegment(outputBuffer, startSample, numSamples, 1.0f, 1.0f);
+    }
 
-                if (outR != nullptr)
-                {
-                    *outL++ += l * jmin(1.0f - curPan, 1.0f);
-                    *outR++ += r * jmin(1.0f + curPan, 1.0f);
-                }
-                else
-                {
-                    *outL++ += (l + r) * 0.5f;
-                }
+    /*
+    * Fades the note out from the given sample of the next
+    * rendered block, over a few milliseconds, then stops it.
+    * Does nothing if the note is already being choked.
+    */
+    void choke(int sampleInBlock)
+    {
+        if (!isVoiceActive() || isChoked())
+            return;
 
-                // Increment sample position and break
-                // if we reached sound total length
-                sourceSamplePosition += pitchRatio;
-                if (sourceSamplePosition >= playingSound->lenght)
-                {
-                    stopNote(0.0f, false);
-                    break;
-                }
-            }
+        chokePosition = sampleInBlock;
+        fadeLength = jmax(1, roundToInt(getSampleRate() * chokeFadeSeconds));
+    }
 
-            // Level
-            if (curGain == prevGain)
-            {
-                outputBuffer.applyGain(curGain);
-            }
-            else
-            {
-                // Creates fades between audio blocks 
-                // if level param is changing
-                outputBuffer.applyGainRamp(0, outputBuffer.getNumSamples(), prevGain, curGain);
-                prevGain = curGain;
-            }
-        }
+    /*
+    * Returns true from the choke of the note to its end.
+    */
+    bool isChoked() const { return chokePosition >= 0 || fadeRemaining > 0; }
+
+    /*
+    * Returns how many blocks of this voice the streamer was late
+    * for since the last call. Called from the audio thread.
+    */
+    int takeUnderruns()
+    {
+        if (stream == nullptr)
+            return 0;
+
+        auto numUnderruns = stream->getNumUnderruns();
+        auto numNew = numUnderruns - numUnderrunsTaken;
+        numUnderrunsTaken = numUnderruns;
+        return numNew;
     }
 
     /*
@@ -300,20 +605,187 @@ public:
     */
     void controllerMoved(int controllerNumber, int newControllerValue) { }
 
-    std::atomic<float>* level;
-    std::atomic<float>* pan;
-    std::atomic<float>* coarse;
-    std::atomic<float>* fine;
-    std::atomic<float>* muteEnabled;
-    float prevGain;
+    /*
+    * Gives this voice a ring buffer to stream samples
+    * longer than the preloaded head.
+    */
+    void setStreamBuffer(StreamBuffer* newStream) { stream.reset(newStream); }
+
+    StreamBuffer* getStreamBuffer() const { return stream.get(); }
+
+    /*
+    * Sets the sample of the next rendered block where the note
+    * starts, as the position of its note-on in that block.
+    */
+    void setStartPosition(int sampleInBlock) { startPosition = sampleInBlock; }
+
+    /*
+    * Returns an estimate of how loud this voice currently is,
+    * used to pick the quietest voice when stealing.
+    */
+    float getLevelEstimate() const
+    {
+        auto* sound = static_cast<DrumSound*> (getCurrentlyPlayingSound().get());
+
+        // A choked note is on its way out anyway
+        if (sound == nullptr || playingSampleRate <= 0.0 || isChoked())
+            return 0.0f;
+
+        return sound->getEnvelope(sourceSamplePosition / playingSampleRate);
+    }
 
 private:
+    static constexpr double chokeFadeSeconds = 0.005;
+
+    /*
+    * Renders numSamples from startSample at the channel gains,
+    * scaled by a level going from startLevel to endLevel.
+    * Stops the note if it reaches its end. If the streamer is
+    * late the rest of the segment stays silent and the note
+    * carries on from the same position once the data is in.
+    */
+    void renderSegment(AudioSampleBuffer& outputBuffer, int startSample, int numSamples, float startLevel, float endLevel)
+    {
+        auto* playingSound = static_cast<DrumSound*> (getCurrentlyPlayingSound().get());
+
+        if (playingSound == nullptr || numSamples <= 0)
+            return;
+
+        // Held by the voice until the note stops, so no reference is taken here
+        if (playingBuffer == nullptr)
+            return;
+
+        auto playingLength = playingCopy != nullptr ? playingCopy->getLength() : playingSound->lenght;
+        auto& data = *playingBuffer->getAudioSampleBuffer();
+        followChannelGains(startSample, numSamples, startLevel, endLevel);
+
+        const int headLength = data.getNumSamples();
+        const bool isStereo = data.getNumChannels() > 1;
+
+        float* outL = outputBuffer.getWritePointer(0, startSample);
+        float* outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
+
+        // Preloaded head: frames until its end are known up front
+        VoiceRenderKernel::PlanarSource head { { data.getReadPointer(0), data.getReadPointer(isStereo ? 1 : 0) } };
+        auto numFrames = VoiceRenderKernel::getNumFramesBefore(headLength, sourceSamplePosition, pitchRatio,
+                                                               numSamples, interpolator.tapsAfter);
+
+        renderFrames(head, isStereo, outL, outR, numFrames);
+        numSamples -= numFrames;
+
+        auto isUnderrun = false;
+
+        // Past the head, read what the streamer has ready
+        if (numSamples > 0 && stream != nullptr && isPlayingStreamed(playingSound))
+        {
+            auto readyEnd = jmin(stream->getReadyEnd(), (int64) playingLength);
+            auto numStreamFrames = VoiceRenderKernel::getNumFramesBefore(readyEnd, sourceSamplePosition, pitchRatio,
+                                                                         numSamples, interpolator.tapsAfter);
+
+            renderFrames(StreamBufferSource { stream.get() }, isStereo,
+                         outL + numFrames,
+                         outR != nullptr ? outR + numFrames : nullptr,
+                         numStreamFrames);
+            numSamples -= numStreamFrames;
+
+            // Also before the streamer took the note, when readyEnd is -1
+            isUnderrun = numSamples > 0 && readyEnd < playingLength;
+
+            if (isUnderrun)
+                stream->reportUnderrun();
+        }
+
+        if (numSamples > 0 && !isUnderrun)
+        {
+            // Reached sound total length
+            stopNote(0.0f, false);
+        }
+        else if (stream != nullptr)
+        {
+            // Let the streamer reuse what we've played,
+            // keeping the taps the next frames still read
+            stream->releaseBefore((int64) sourceSamplePosition - interpolator.tapsBefore);
+        }
+    }
+
+    /*
+    * Hands the buffers of the last note to the release queue,
+    * so the audio thread never frees one a reload replaced.
+    * The stream must be stopped first: the queue relies on it
+    * to know when the streamer is done with them.
+    */
+    void releaseSample()
+    {
+        releaseQueue.retire(playingBuffer);
+        releaseQueue.retire(playingCopy);
+    }
+
+    bool isPlayingStreamed(DrumSound* sound) const
+    {
+        return playingCopy != nullptr ? playingCopy->isStreamed() : sound->isStreamed();
+    }
+
+    /*
+    * Sets the gains to follow the channel's smoothed gains
+    * from firstSample of the block over numFrames, so every
+    * voice of the channel ramps along the same line,
+    * scaled by the voice's own level at both ends.
+    */
+    void followChannelGains(int firstSample, int numFrames, float startLevel, float endLevel)
+    {
+        gainL.reset(jmax(1, numFrames));
+        gainR.reset(jmax(1, numFrames));
+        gainL.setCurrentAndTargetValue(channel.getGain(0, firstSample) * startLevel);
+        gainR.setCurrentAndTargetValue(channel.getGain(1, firstSample) * startLevel);
+        gainL.setTargetValue(channel.getGain(0, firstSample + numFrames) * endLevel);
+        gainR.setTargetValue(channel.getGain(1, firstSample + numFrames) * endLevel);
+    }
+
+    /*
+    * Kernel view of the voice's stream buffer.
+    */
+    struct StreamBufferSource
+    {
+        static constexpr bool isContiguous = false;
+
+        float getSample(int channel, int64 index) const noexcept { return stream->getSample(channel, index); }
+        const float* getPointer(int, int64) const noexcept { return nullptr; }
+
+        const StreamBuffer* stream;
+    };
+
+    /*
+    * Renders numFrames through the kernel and moves the play position.
+    */
+    template <typename SourceType>
+    void renderFrames(const SourceType& source, bool isStereo, float* outL, float* outR, int numFrames)
+    {
+        if (isStereo)
+            sourceSamplePosition = VoiceRenderKernel::render<2>(source, outL, outR, numFrames,
+                                                                sourceSamplePosition, pitchRatio, interpolator, gainL, gainR);
+        else
+            sourceSamplePosition = VoiceRenderKernel::render<1>(source, outL, outR, numFrames,
+                                                                sourceSamplePosition, pitchRatio, interpolator, gainL, gainR);
+    }
+
+    const ChannelSnapshot& channel;
+    std::unique_ptr<StreamBuffer> stream;
+    SharedResourcePointer<SincTable> sincTable;
+    VoiceRenderKernel::Interpolator interpolator;
+    ReleaseQueue& releaseQueue;
+    ResampledSample::Ptr playingCopy;
+    ReferenceCountedBuffer::Ptr playingBuffer;     // head of playingCopy, or of the sound
     float semitones = 0.0;
     float cents = 0.0;
     double pitchRatio = 0;
+    double playingSampleRate = 0;
+    int startPosition = 0;
+    int chokePosition = -1;
+    int fadeRemaining = 0;
+    int fadeLength = 1;
+    int numUnderrunsTaken = 0;
+    VoiceRenderKernel::Gain gainL, gainR;
     double sourceSamplePosition = 0;
-    bool isMuteEnabled = false;
-    bool isSoloEnabled = false;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumVoice)
 };
\ No newline at end of file
@@ -2,15 +2,21 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "DrumSound.h"
-
+#include "VoicePool.h"
+#include "VelocityLayerTable.h"
+#include "RoundRobin.h"
+#include "../utils/SampleLoader.h"
+#include "../utils/ReleaseQueue.h"
 
 class DrumSynth : public Synthesiser
 {
 public:
     enum
     {
-        maxSoundsPerRange = 1,
+        maxRoundRobins = 16,
         maxVoices = 100,
+        numSpareVoices = 4,     // play notes while the voices they steal fade out
+        maxChokesPerBlock = 128,
         numVelocityRange = 2
     };
 
@@ -18,21 +24,152 @@ public:
     DrumSynth(
         AudioProcessorValueTreeState& vts,
         const String name,
-        const int defaultNote
+        const String kitChannelName,
+        const File& kitSampleFolder,
+        const int defaultNote,
+        const int numRoundRobins,
+        SampleStreamer& sampleStreamer,
+        const StreamingOptions& streamingOptions,
+        SampleLoader& sampleLoader,
+        ReleaseQueue& releaseQueue
     )
         : parameters(vts)
+        , channelParameters(vts, name)
+        , streamer(sampleStreamer)
+        , loader(sampleLoader)
+        , streaming(streamingOptions)
     {
         chName = name;
+        sampleName = kitChannelName;
+        sampleFolder = kitSampleFolder;
         note = defaultNote;
+        roundRobins = jlimit(1, (int) maxRoundRobins, numRoundRobins);
+
+        Array<DrumVoice*> newVoices;
+
+        for (int i = maxVoices + numSpareVoices; --i >= 0;)
+        {
+            auto* newVoice = new DrumVoice(channelParameters.getSnapshot(), releaseQueue);
+            newVoices.add(newVoice);
+
+            // Each voice gets its own ring, filled by the streamer thread
+            if (streaming.enabled)
+            {
+                newVoice->setStreamBuffer(new StreamBuffer(2, streaming.readAheadSamples));
+                streamer.addStream(newVoice->getStreamBuffer());
+            }
 
-        for (int i = maxVoices; --i >= 0;)
-            addVoice(new DrumVoice());
+            addVoice(newVoice);
+        }
 
+        voicePool.setVoices(newVoices, numSpareVoices);
         addSounds();
     }
 
     ~DrumSynth()
-    { }
+    {
+        for (auto* v : voices)
+            if (auto* stream = static_cast<DrumVoice*> (v)->getStreamBuffer())
+                streamer.removeStream(stream);
+    }
+
+    /*
+    * Renders the block in a single pass over the voices.
+    * Midi events are all handled first: voices started by a note-on
+    * remember its position and only start mixing from there, so the
+    * block is never split however many notes it holds.
+    * Chokes queued by addChoke() are applied in time order with
+    * the midi events, before a note-on at the same position.
+    * Replaces juce::Synthesiser::renderNextBlock, which holds the
+    * synth lock for the whole block: here voices and sounds are
+    * only touched from the audio thread once set up, so no lock is needed.
+    */
+    void renderBlock(AudioBuffer<float>& outputAudio, const MidiBuffer& midiData, int startSample, int numSamples)
+    {
+        // Learn was turned off since the last note learnt: it can start again
+        if (learnt && learnEnabled->load() <= 0.5f)
+            learnt = false;
+
+        if (numSamples <= 0)
+        {
+            numChokes = 0;
+            return;
+        }
+
+        auto nextChoke = 0;
+
+        for (const auto metadata : midiData)
+        {
+            eventPosition = jlimit(startSample, startSample + numSamples - 1, metadata.samplePosition);
+
+            for (; nextChoke < numChokes && chokePositions[nextChoke] <= eventPosition; ++nextChoke)
+                chokeVoices(jlimit(startSample, startSample + numSamples - 1, chokePositions[nextChoke]));
+
+            handleMidiEvent(metadata.getMessage());
+        }
+
+        for (; nextChoke < numChokes; ++nextChoke)
+            chokeVoices(jlimit(startSample, startSample + numSamples - 1, chokePositions[nextChoke]));
+
+        numChokes = 0;
+        eventPosition = 0;
+        renderVoices(outputAudio, startSample, numSamples);
+
+        // Voices that just ended are still in the list
+        if (streaming.enabled)
+        {
+            auto* active = voicePool.getActiveVoices();
+
+            for (auto i = 0; i < voicePool.getNumActive(); ++i)
+                numUnderruns += active[i]->takeUnderruns();
+        }
+
+        voicePool.releaseFinished();
+    }
+
+    /*
+    * Renders only the voices the pool has handed out,
+    * so the cost follows polyphony rather than maxVoices.
+    * Override of juce:Synthesiser method.
+    */
+    void renderVoices(AudioBuffer<float>& outputAudio, int startSample, int numSamples) override
+    {
+        if (!activeListEnabled)
+        {
+            Synthesiser::renderVoices(outputAudio, startSample, numSamples);
+            return;
+        }
+
+        auto* active = voicePool.getActiveVoices();
+
+        for (auto i = 0; i < voicePool.getNumActive(); ++i)
+            if (active[i]->isVoiceActive())
+                active[i]->renderNextBlock(outputAudio, startSample, numSamples);
+    }
+
+    /*
+    * Enables or disables rendering from the active voice list.
+    * When disabled every voice is visited, as juce::Synthesiser does.
+    * Used by the benchmark to compare both paths.
+    */
+    void setActiveListEnabled(bool shouldBeEnabled) { activeListEnabled = shouldBeEnabled; }
+
+    /*
+    * Sets what happens to a note-on when all voices are busy.
+    */
+    void setStealingPolicy(VoicePool::StealingPolicy newPolicy) { voicePool.setStealingPolicy(newPolicy); }
+
+    /*
+    * Sets how a layer's round-robin samples alternate.
+    * Must not be called while rendering.
+    */
+    void setRoundRobinMode(RoundRobin::Mode newMode) { roundRobin.setMode(newMode); }
+
+    /*
+    * Parameters of this channel, read by its voices
+    * from the snapshot taken for each block.
+    */
+    ChannelParameters& getChannelParameters() { return channelParameters; }
 
     /*
     * Handles incoming midi events inside the midi buffer
@@ -45,16 +182,15 @@ public:
 
         if (m.isNoteOn())
         {
-            if (*learnEnabled)
+            if (isLearning())
             {
-                String paramId = "p";
+                // The processor has the message thread turn learn off
                 midiLearn(m);
-                parameters.getParameter(paramId << chName << "Learn")->setValueNotifyingHost(false);
+                learnt = true;
             }
             else
             {
                 noteOn(channel, m.getNoteNumber(), m.getFloatVelocity());
-                voicesToLog(m.getNoteNumber(), m.getFloatVelocity());
             }
         }
         else if (m.isNoteOff())
@@ -64,7 +200,7 @@ public:
         }
         else if (m.isAllNotesOff() || m.isAllSoundOff())
         {
-            allNotesOff(channel, true);
+            stopAllVoices();
         }
         else if (m.isPitchWheel())
         {
@@ -92,38 +228,98 @@ public:
 
     /*
     * Triggers a note on message.
+    * Finds the velocity layers to play in the layer table,
+    * picks one round-robin sample of each and takes a voice
+    * from the pool for it, rather than testing every sound
+    * and searching every voice under the synth lock.
     * Override of juce:Synthesiser method.
     */
     void noteOn(const int midiChannel,
                  const int midiNoteNumber,
                  const float velocity)	override
     {
-        const ScopedLock sl(lock);
+        auto layerMask = layerTable.getLayers(midiNoteNumber, velocity);
 
-        for (auto* soundSource : sounds)
+        for (auto l = 0; layerMask != 0; ++l, layerMask >>= 1)
         {
-            auto* const sound = static_cast<DrumSound* const> (soundSource);
+            if ((layerMask & 1) == 0)
+                continue;
 
-            if (sound->appliesTo(midiNoteNumber, velocity) && sound->appliesToChannel(midiChannel))
+            auto& sounds = layers.getReference(l).sounds;
+            auto* sound = sounds.getUnchecked(roundRobin.choose(l, midiNoteNumber, sounds.size()));
+
+            if (!sound->appliesToChannel(midiChannel))
+                continue;
+
+            // Pool is exhausted and the policy doesn't steal
+            if (auto* freeVoice = voicePool.allocate(sound, eventPosition))
+            {
+                startVoice(freeVoice, sound, midiChannel, midiNoteNumber, velocity);
+                freeVoice->setStartPosition(eventPosition);
+            }
+            else
             {
-                auto voice = findFreeVoice(sound, midiChannel, midiNoteNumber, shouldStealNotes);
-                startVoice(voice, sound, midiChannel, midiNoteNumber, velocity);
+                ++numDroppedNotes;
             }
         }
     }
 
+    /*
+    * Queues a choke of every voice playing at the given sample
+    * of the next rendered block. Positions must come in time order.
+    * Called from the audio thread before rendering the block,
+    * so a note of another channel can choke this one.
+    */
+    void addChoke(int sampleInBlock)
+    {
+        if (numChokes > 0 && chokePositions[numChokes - 1] >= sampleInBlock)
+            return;
+
+        // Later chokes of a crowded block are dropped
+        if (numChokes < (int) maxChokesPerBlock)
+            chokePositions[numChokes++] = sampleInBlock;
+    }
+
+    /*
+    * Fades out every playing voice from the given sample.
+    * Voices go back to the pool as soon as their fade ends,
+    * visiting only the pool's active voices.
+    */
+    void chokeVoices(int sampleInBlock)
+    {
+        auto* active = voicePool.getActiveVoices();
+
+        for (auto i = 0; i < voicePool.getNumActive(); ++i)
+            active[i]->choke(sampleInBlock);
+    }
+
+    /*
+    * Stops every playing voice and gives it back to the pool.
+    */
+    void stopAllVoices()
+    {
+        auto* active = voicePool.getActiveVoices();
+
+        for (auto i = 0; i < voicePool.getNumActive(); ++i)
+            if (active[i]->isVoiceActive())
+                active[i]->stopNote(0.0f, false);
+
+        voicePool.releaseFinished();
+    }
+
     /*
     * Updates- each sound's playing note with given midi note.
     */
     void midiLearn(const MidiMessage& msg)
     {
         note = msg.getNoteNumber();
-        DBG(note);
         for (auto* soundSource : sounds)
         {
             auto* const sound = static_cast<DrumSound* const> (soundSource);
             sound->setMidiNote(note);
         }
+
+        rebuildLayerTable();
     }
 
     /*
@@ -132,13 +328,111 @@ public:
     */
     void attachMidiLearn(std::atomic<float>* ptr) { learnEnabled = ptr; }
 
+    /*
+    * Returns true while midi learn is waiting for a note.
+    */
+    bool isLearning() const { return learnEnabled != nullptr && learnEnabled->load() > 0.5f && !learnt; }
+
+    /*
+    * Returns true from the note learnt until
+    * the learn parameter is turned off.
+    */
+    bool hasLearnt() const { return learnt; }
+
+    /*
+    * Returns the midi note this synth is currently mapped to.
+    */
+    int getMidiNote() const { return note; }
+
+    /*
+    * Queues on the loader a copy of every sound at the given
+    * host rate, so unpitched voices don't have to resample.
+    */
+    void prepareSounds(double sampleRate)
+    {
+        Array<std::function<void()>> jobs;
+
+        // Jobs hold their sound, so a kit may go away before they run
+        for (auto* soundSource : sounds)
+        {
+            SynthesiserSound::Ptr soundToPrepare(soundSource);
+            jobs.add([soundToPrepare, sampleRate] { static_cast<DrumSound*> (soundToPrepare.get())->prepareForRate(sampleRate); });
+        }
+
+        loader.addJobs(jobs, nullptr);
+    }
+
+    /*
+    * Returns true once the loader has read every sound of this synth.
+    */
+    bool isLoaded() const { return loaded->load(); }
+
+    /*
+    * Returns the memory used by this synth's sample data,
+    * including the voices' stream buffers.
+    */
+    int64 getResidentBytes()
+    {
+        int64 numBytes = 0;
+
+        for (auto* soundSource : sounds)
+            numBytes += static_cast<DrumSound*> (soundSource)->getResidentBytes();
+
+        for (auto* v : voices)
+            if (auto* stream = static_cast<DrumVoice*> (v)->getStreamBuffer())
+                numBytes += stream->getSizeInBytes();
+
+        return numBytes;
+    }
+
+    /*
+    * Returns how many note-ons found no voice to play them
+    * since the last call, and starts counting again.
+    * Called from the audio thread after rendering.
+    */
+    int takeDroppedNotes()
+    {
+        auto numDropped = numDroppedNotes;
+        numDroppedNotes = 0;
+        return numDropped;
+    }
+
+    /*
+    * Returns how many times a voice ran out of streamed data
+    * since the last call, and starts counting again.
+    * Called from the audio thread after rendering.
+    */
+    int takeUnderruns()
+    {
+        auto numTaken = numUnderruns;
+        numUnderruns = 0;
+        return numTaken;
+    }
+
+    /*
+    * Returns the number of voices currently playing a sound.
+    */
+    int getNumActiveVoices()
+    {
+        auto numActive = 0;
+        auto* active = voicePool.getActiveVoices();
+
+        for (auto i = 0; i < voicePool.getNumActive(); ++i)
+            if (active[i]->isVoiceActive())
+                ++numActive;
+
+        return numActive;
+    }
+
 private:
     /*
     * Adds new sounds to this synth.
-    * Each sound will start a thread and read a file from disk
+    * Once set up, every sound is queued on the shared loader
+    * to read its file from disk.
     */
     void addSounds()
     {
+        Array<std::function<void()>> loadJobs;
         Range<float> velocityRange;
         float velocityTot = 1.0f;
         float start = 1.0f / 128.0f;
@@ -149,74 +443,83 @@ private:
             velocityRange.setStart(start);
             velocityRange.setEnd(start + lenght);
 
-            for (auto i = 1; i <= maxSoundsPerRange; i++)
+            Layer layer;
+            layer.velocity = velocityRange;
+
+            // Round-robin samples are numbered from 1 in the file name
+            for (auto i = 1; i <= roundRobins; i++)
             {
-                addSound(sound = new DrumSound());
-                sound->setName(chName);
+                addSound(sound = new DrumSound(streaming));
+                sound->setName(sampleName);
+                sound->setSampleFolder(sampleFolder);
                 sound->setVelocityRange(velocityRange);
                 sound->setIndex(i);
                 sound->setMidiNote(note);
+                layer.sounds.add(sound);
+
+                SynthesiserSound::Ptr soundToLoad(sound);
+                loadJobs.add([soundToLoad] { static_cast<DrumSound*> (soundToLoad.get())->load(); });
             }
+
+            layers.add(layer);
             start += lenght;
             if (start > velocityTot)
                 break;
         }
+
+        rebuildLayerTable();
+
+        auto loadedFlag = loaded;
+        loader.addJobs(loadJobs, [loadedFlag] { *loadedFlag = true; });
     }
 
     /*
-    * Prints active voices preceeded by a "note on" flag.
-    * For debugging purposes only.
+    * Maps the velocities of the current note to the layers.
+    * Called when layers or the midi note change.
     */
-    void voicesToLog(int midiNote, float velocity)
+    void rebuildLayerTable()
     {
-        //if (velocity > 0.0f)
-        //    DBG("                     <<<<<< note on");
-
-        int voiceIndex = 0;
-        int numVoices = getNumVoices();
-        String msg;
-
-        // Prints all active voices
-        Array<int> activeVoices;
-        for (int i = 0; i < numVoices; i++)
-        {
-            voice = voices[i];
-            if (voice->isVoiceActive())
-            {
-                activeVoices.add(i);
-            }
-        }
-
-        msg << chName << " active voices: ";
-
-        for (auto index : activeVoices)
-            msg << index << ", ";
-
-        msg << "\n";
+        Range<float> ranges[VelocityLayerTable::maxLayers];
+        auto numLayers = jmin(layers.size(), (int) VelocityLayerTable::maxLayers);
 
-        DBG(msg);
+        for (auto l = 0; l < numLayers; ++l)
+            ranges[l] = layers.getReference(l).velocity;
 
-        // Prints only the last active voice
-        //for (int i = numVoices - 1; i >= 0; i--)
-        //{
-        //    voice = voices[i];
-        //    if (voice->isVoiceActive()) {
-        //        voiceIndex = i;
-        //        msg << "voice: " << voiceIndex << ", startNote: " << midiNote << "\n";
-        //        DBG(msg);
-        //        break;
-        //    }
-        //}
+        layerTable.rebuild(note, ranges, numLayers);
     }
 
     AudioProcessorValueTreeState& parameters;
+    ChannelParameters channelParameters;
+    SampleStreamer& streamer;
+    SampleLoader& loader;
+    StreamingOptions streaming;
+    std::shared_ptr<std::atomic<bool>> loaded { std::make_shared<std::atomic<bool>>(false) };
     DrumSound* sound;
-    SynthesiserVoice* voice;
     std::unique_ptr<File> file;
-    std::atomic<float>* learnEnabled;
-    bool mutingEnabled = false;
-    bool shouldStealNotes = false;
-    String chName;
+    std::atomic<float>* learnEnabled = nullptr;
+    bool learnt = false;
+    VoicePool voicePool;
+
+    // Sounds sharing a velocity range, in the order they were added
+    struct Layer
+    {
+        Range<float> velocity;
+        Array<DrumSound*> sounds;
+    };
+
+    Array<Layer> layers;
+    VelocityLayerTable layerTable;
+    RoundRobin roundRobin;
+    int roundRobins = 1;
+    bool activeListEnabled = true;
+    int eventPosition = 0;
+    int numDroppedNotes = 0;
+    int numUnderruns = 0;
+    int chokePositions[maxChokesPerBlock];
+    int numChokes = 0;
+    String chName;          // slot whose parameters this synth follows
+    String sampleName;      // kit channel whose samples it plays
+    File sampleFolder;
     int note;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumSynth)
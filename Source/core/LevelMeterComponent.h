@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../dsp/LevelMeter.h"
+
+/*
+* Stereo meter bars: RMS filled, peak as a line above it,
+* and a red cap once the true peak goes over 0 dBFS.
+* Repaints only when given readings that differ from the last.
+*/
+class LevelMeterComponent : public Component
+{
+public:
+    LevelMeterComponent() { setInterceptsMouseClicks(false, false); }
+
+    void setReadings(const LevelMeter::Reading* newReadings)
+    {
+        auto changed = false;
+
+        for (auto ch = 0; ch < LevelMeter::maxChannels; ++ch)
+        {
+            auto& r = newReadings[ch];
+            auto& old = readings[ch];
+            changed = changed || r.peak != old.peak || r.rms != old.rms || r.truePeak != old.truePeak;
+            old = r;
+        }
+
+        if (changed)
+            repaint();
+    }
+
+    void paint(Graphics& g) override
+    {
+        auto bounds = getLocalBounds().toFloat();
+        auto barWidth = bounds.getWidth() / (float) LevelMeter::maxChannels;
+
+        g.setColour(Colours::black);
+        g.fillRect(bounds);
+
+        for (auto ch = 0; ch < LevelMeter::maxChannels; ++ch)
+        {
+            auto bar = bounds.withX(bounds.getX() + barWidth * (float) ch).withWidth(barWidth).reduced(1.0f);
+            auto& r = readings[ch];
+
+            g.setColour(Colours::limegreen);
+            g.fillRect(bar.withTop(bar.getBottom() - bar.getHeight() * toProportion(r.rms)));
+
+            g.setColour(Colours::yellow);
+            g.fillRect(bar.withTop(bar.getBottom() - bar.getHeight() * toProportion(r.peak)).withHeight(2.0f));
+
+            if (r.truePeak > 1.0f)
+            {
+                g.setColour(Colours::red);
+                g.fillRect(bar.withHeight(4.0f));
+            }
+        }
+    }
+
+private:
+    static constexpr float minDb = -60.0f;
+    static constexpr float maxDb = 6.0f;
+
+    static float toProportion(float gain)
+    {
+        auto db = Decibels::gainToDecibels(gain, minDb);
+        return jlimit(0.0f, 1.0f, jmap(db, minDb, maxDb, 0.0f, 1.0f));
+    }
+
+    LevelMeter::Reading readings[LevelMeter::maxChannels];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeterComponent)
+};
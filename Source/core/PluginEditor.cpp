@@ -32,7 +32,10 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     Logger::getCurrentLogger()->writeToLog(">>>>>>>>> DrumEditor constructor called.");
 
     const MessageManagerLock mmLock;
-    startTimer(100);
+
+    // Meters cost the audio thread a copy per channel, paid only while shown
+    processor.setMeteringEnabled(true);
+    startTimerHz(meterRefreshHz);
 
     // CHANNELS
     auto index = 0;
@@ -48,11 +51,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     auto curMuteButton = &muteButton1;
     auto curSoloButton = &soloButton1;
     auto curLearnButton = &midiLearnButton1;
-    auto curLevelAttach = levelAttachment1.get();
-    auto curPanAttach = panAttachment1.get();
-    auto curMuteAttach = muteAttachment1.get();
-    auto curSoloAttach = soloAttachment1.get();
-    auto curLearnAttach = midiLearnAttachment1.get();
+    auto curLevelAttach = &levelAttachment1;
+    auto curPanAttach = &panAttachment1;
+    auto curMuteAttach = &muteAttachment1;
+    auto curSoloAttach = &soloAttachment1;
+    auto curLearnAttach = &midiLearnAttachment1;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -67,11 +70,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton2;
     curSoloButton = &soloButton2;
     curLearnButton = &midiLearnButton2;
-    curLevelAttach = levelAttachment2.get();
-    curPanAttach = panAttachment2.get();
-    curMuteAttach = muteAttachment2.get();
-    curSoloAttach = soloAttachment2.get();
-    curLearnAttach = midiLearnAttachment2.get();
+    curLevelAttach = &levelAttachment2;
+    curPanAttach = &panAttachment2;
+    curMuteAttach = &muteAttachment2;
+    curSoloAttach = &soloAttachment2;
+    curLearnAttach = &midiLearnAttachment2;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -86,11 +89,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton3;
     curSoloButton = &soloButton3;
     curLearnButton = &midiLearnButton3;
-    curLevelAttach = levelAttachment3.get();
-    curPanAttach = panAttachment3.get();
-    curMuteAttach = muteAttachment3.get();
-    curSoloAttach = soloAttachment3.get();
-    curLearnAttach = midiLearnAttachment3.get();
+    curLevelAttach = &levelAttachment3;
+    curPanAttach = &panAttachment3;
+    curMuteAttach = &muteAttachment3;
+    curSoloAttach = &soloAttachment3;
+    curLearnAttach = &midiLearnAttachment3;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -105,11 +108,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton4;
     curSoloButton = &soloButton4;
     curLearnButton = &midiLearnButton4;
-    curLevelAttach = levelAttachment4.get();
-    curPanAttach = panAttachment4.get();
-    curMuteAttach = muteAttachment4.get();
-    curSoloAttach = soloAttachment4.get();
-    curLearnAttach = midiLearnAttachment4.get();
+    curLevelAttach = &levelAttachment4;
+    curPanAttach = &panAttachment4;
+    curMuteAttach = &muteAttachment4;
+    curSoloAttach = &soloAttachment4;
+    curLearnAttach = &midiLearnAttachment4;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -124,11 +127,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton5;
     curSoloButton = &soloButton5;
     curLearnButton = &midiLearnButton5;
-    curLevelAttach = levelAttachment5.get();
-    curPanAttach = panAttachment5.get();
-    curMuteAttach = muteAttachment5.get();
-    curSoloAttach = soloAttachment5.get();
-    curLearnAttach = midiLearnAttachment5.get();
+    curLevelAttach = &levelAttachment5;
+    curPanAttach = &panAttachment5;
+    curMuteAttach = &muteAttachment5;
+    curSoloAttach = &soloAttachment5;
+    curLearnAttach = &midiLearnAttachment5;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -143,11 +146,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton6;
     curSoloButton = &soloButton6;
     curLearnButton = &midiLearnButton6;
-    curLevelAttach = levelAttachment6.get();
-    curPanAttach = panAttachment6.get();
-    curMuteAttach = muteAttachment6.get();
-    curSoloAttach = soloAttachment6.get();
-    curLearnAttach = midiLearnAttachment6.get();
+    curLevelAttach = &levelAttachment6;
+    curPanAttach = &panAttachment6;
+    curMuteAttach = &muteAttachment6;
+    curSoloAttach = &soloAttachment6;
+    curLearnAttach = &midiLearnAttachment6;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -162,11 +165,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton7;
     curSoloButton = &soloButton7;
     curLearnButton = &midiLearnButton7;
-    curLevelAttach = levelAttachment7.get();
-    curPanAttach = panAttachment7.get();
-    curMuteAttach = muteAttachment7.get();
-    curSoloAttach = soloAttachment7.get();
-    curLearnAttach = midiLearnAttachment7.get();
+    curLevelAttach = &levelAttachment7;
+    curPanAttach = &panAttachment7;
+    curMuteAttach = &muteAttachment7;
+    curSoloAttach = &soloAttachment7;
+    curLearnAttach = &midiLearnAttachment7;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -181,11 +184,11 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &muteButton8;
     curSoloButton = &soloButton8;
     curLearnButton = &midiLearnButton8;
-    curLevelAttach = levelAttachment8.get();
-    curPanAttach = panAttachment8.get();
-    curMuteAttach = muteAttachment8.get();
-    curSoloAttach = soloAttachment8.get();
-    curLearnAttach = midiLearnAttachment8.get();
+    curLevelAttach = &levelAttachment8;
+    curPanAttach = &panAttachment8;
+    curMuteAttach = &muteAttachment8;
+    curSoloAttach = &soloAttachment8;
+    curLearnAttach = &midiLearnAttachment8;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
@@ -200,17 +203,41 @@ DrumEditor::DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts)
     curMuteButton = &masterMuteButton;
     curSoloButton = nullptr;
     curLearnButton = nullptr;
-    curLevelAttach = masterLevelAttachment.get();
-    curPanAttach = masterPanAttachment.get();
-    curMuteAttach = masterMuteAttachment.get();
+    curLevelAttach = &masterLevelAttachment;
+    curPanAttach = &masterPanAttachment;
+    curMuteAttach = &masterMuteAttachment;
 
     initChannel(vts, name, ++index, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton,
         curSoloButton, curLearnButton, curLevelAttach, curPanAttach, curMuteAttach, curSoloAttach, curLearnAttach);
 
+    // Meters, one per channel group plus master
+    GroupComponent* groups[] = { &group1, &group2, &group3, &group4, &group5, &group6, &group7, &group8 };
+    channelMeters.addArray({ &meter1, &meter2, &meter3, &meter4, &meter5, &meter6, &meter7, &meter8 });
+
+    for (auto i = 0; i < channelMeters.size(); i++)
+        groups[i]->addAndMakeVisible(channelMeters[i]);
+
+    masterGroup.addAndMakeVisible(masterMeter);
+
+    // Performance counters
+    addAndMakeVisible(performanceLabel);
+    performanceLabel.setFont(Font(13.00f, Font::plain));
+    performanceLabel.setJustificationType(Justification::centredLeft);
+
+    // Kit
+    addAndMakeVisible(kitButton);
+    kitButton.onClick = [this] { chooseKit(); };
+    updateKitButton();
+
     // Window size
     setSize(1000, 600);
 }
 
+DrumEditor::~DrumEditor()
+{
+    processor.setMeteringEnabled(false);
+}
+
 void  DrumEditor::paint(Graphics& g)
 {
     g.fillAll(getLookAndFeel().findColour(ResizableWindow::backgroundColourId));
@@ -331,14 +358,43 @@ void  DrumEditor::resized()
     curLevelSlider = &masterLevelSlider;
     curPanSlider = &masterPanSlider;
     curMuteButton = &masterMuteButton;
+    curSoloButton = nullptr;
+    curLearnButton = nullptr;
 
     drawChannel(start, curGroup, curLevelLabel, curPanLabel, curLevelSlider, curPanSlider, curMuteButton, curSoloButton, curLearnButton);
 
+    // Meters
+    Slider* levelSliders[] = { &levelSlider1, &levelSlider2, &levelSlider3, &levelSlider4,
+                               &levelSlider5, &levelSlider6, &levelSlider7, &levelSlider8 };
+
+    for (auto i = 0; i < channelMeters.size(); i++)
+        placeMeter(*levelSliders[i], *channelMeters[i]);
+
+    placeMeter(masterLevelSlider, masterMeter);
+
+    auto kitButtonWidth = 200;
+    kitButton.setBounds(getWidth() - startingPoint - kitButtonWidth, getHeight() - 25, kitButtonWidth, 20);
+    performanceLabel.setBounds(startingPoint, getHeight() - 25, kitButton.getX() - 2 * startingPoint, 20);
 }
 
 void  DrumEditor::timerCallback()
 {
-    repaint();
+    // Meters repaint themselves when their readings change,
+    // the rest of the editor follows its attachments
+    if (processor.readMeters(meterSnapshot))
+    {
+        for (auto i = 0; i < jmin(channelMeters.size(), meterSnapshot.numChannels); i++)
+            channelMeters[i]->setReadings(meterSnapshot.channels[i]);
+
+        masterMeter.setReadings(meterSnapshot.master);
+    }
+
+    if (++ticksSincePerformanceUpdate >= performanceRefreshTicks)
+    {
+        ticksSincePerformanceUpdate = 0;
+        updatePerformanceLabel();
+        updateKitButton();
+    }
 
     //if (processor.synth[0]->isMidiLearning)
     //{
@@ -364,15 +420,20 @@ void  DrumEditor::initChannel(AudioProcessorValueTreeState& vts,
     Button* muteButton,
     Button* soloButton,
     Button* midiLearnButton,
-    SliderAttachment* levelAttachment,
-    SliderAttachment* panAttachment,
-    ButtonAttachment* muteAttachment,
-    ButtonAttachment* soloAttachment,
-    ButtonAttachment* midiLearnAttachment
+    std::unique_ptr<SliderAttachment>* levelAttachment,
+    std::unique_ptr<SliderAttachment>* panAttachment,
+    std::unique_ptr<ButtonAttachment>* muteAttachment,
+    std::unique_ptr<ButtonAttachment>* soloAttachment,
+    std::unique_ptr<ButtonAttachment>* midiLearnAttachment
 )
 {
     String componentID, paramID, title;
 
+    // Groups past the channels of mixer_info.xml have
+    // no parameters to attach to, so they are left out
+    if (channelName.isEmpty())
+        return;
+
     componentID = static_cast<String>(index);
     title.clear();
     title << "#" << componentID << ": " << channelName;
@@ -393,32 +454,32 @@ void  DrumEditor::initChannel(AudioProcessorValueTreeState& vts,
     // Sliders
     initSlider(*levelSlider, Slider::LinearVertical);
     levelSlider->setRange(0, 1, 0);
-    levelAttachment = new SliderAttachment(vts, paramID << "p" << channelName << "Level", *levelSlider);
+    levelAttachment->reset(new SliderAttachment(vts, paramID << "p" << channelName << "Level", *levelSlider));
     paramID.clear();
 
     initSlider(*panSlider, Slider::LinearHorizontal);
     panSlider->setRange(-50.0, 50.0, 0.01);
-    panAttachment = new SliderAttachment(vts, paramID << "p" << channelName << "Pan", *panSlider);
+    panAttachment->reset(new SliderAttachment(vts, paramID << "p" << channelName << "Pan", *panSlider));
     paramID.clear();
 
     // Mute Button
     initButton(*muteButton);
     muteButton->setButtonText(TRANS("M"));
-    muteAttachment = new ButtonAttachment(vts, paramID << "p" << channelName << "Mute", *muteButton);
+    muteAttachment->reset(new ButtonAttachment(vts, paramID << "p" << channelName << "Mute", *muteButton));
     paramID.clear();
 
     // Solo Button
     if (soloButton != nullptr) {
         initButton(*soloButton);
         soloButton->setButtonText(TRANS("S"));
-        soloAttachment = new ButtonAttachment(vts, paramID << "p" << channelName << "Solo", *soloButton);
+        soloAttachment->reset(new ButtonAttachment(vts, paramID << "p" << channelName << "Solo", *soloButton));
         paramID.clear();
     }
     // Learn Button
     if (midiLearnButton != nullptr) {
         initButton(*midiLearnButton);
         midiLearnButton->setButtonText(TRANS("Learn"));
-        midiLearnAttachment = new ButtonAttachment(vts, paramID << "p" << channelName << "Learn", *midiLearnButton);
+        midiLearnAttachment->reset(new ButtonAttachment(vts, paramID << "p" << channelName << "Learn", *midiLearnButton));
     }
 
     // Attach components
@@ -434,6 +495,63 @@ void  DrumEditor::initChannel(AudioProcessorValueTreeState& vts,
 }
 
 
+void  DrumEditor::updatePerformanceLabel()
+{
+    auto summary = processor.getPerformanceCounters().getSummary();
+    String text;
+
+    text << "Load " << String(summary.averageLoad * 100.0f, 1) << "% (peak " << String(summary.peakLoad * 100.0f, 1) << "%)"
+         << "   Voices " << summary.activeVoices
+         << "   Dropped notes " << summary.droppedNotes
+         << "   Stream underruns " << summary.streamUnderruns
+         << "   Late blocks " << summary.numOverruns
+         << "   Loader queue " << summary.loaderQueue
+         << "   Release queue " << summary.releaseQueue;
+
+    for (auto i = 0; i < jmin(summary.numChannels, outputs.size()); i++)
+        text << "   " << outputs[i] << " " << String(summary.channelMicros[i], 0) << " us";
+
+    performanceLabel.setText(text, dontSendNotification);
+}
+
+void  DrumEditor::chooseKit()
+{
+    kitChooser = std::make_unique<FileChooser>("Load a kit", processor.getKit()->getFile(), "*.xml");
+
+    kitChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                            [this] (const FileChooser& chooser)
+                            {
+                                auto kitFile = chooser.getResult();
+
+                                if (kitFile.existsAsFile())
+                                {
+                                    processor.loadKit(kitFile);
+                                    updateKitButton();
+                                }
+                            });
+}
+
+void  DrumEditor::updateKitButton()
+{
+    auto text = processor.isKitLoading() ? String("Loading kit...") : "Kit: " + processor.getKit()->getName();
+
+    if (kitButton.getButtonText() != text)
+        kitButton.setButtonText(text);
+}
+
+void  DrumEditor::placeMeter(Component& levelSlider, LevelMeterComponent& meter)
+{
+    auto meterWidth = 16;
+    auto slider = levelSlider.getBoundsInParent();
+
+    meter.setBounds(
+        slider.getRight() - meterWidth - 5,     // x
+        slider.getY(),                          // y
+        meterWidth,                             // width
+        slider.getHeight() - 20);               // height, above the text box
+}
+
+
 void  DrumEditor::drawChannel(int startX,
     Component* group,
     Component* levelLabel,
@@ -483,21 +601,26 @@ void  DrumEditor::drawChannel(int startX,
         buttonWidth,									// width
         buttonHeight);								// height
 
-    soloButton->setBounds(
-        muteButton->getX() + buttonWidth - blankSpace / 2,			// x
-        blankSpace + panSlider->getY() + panSlider->getHeight(),											// y
-        buttonWidth,									// width
-        buttonHeight);								// height
+    // Master has no solo nor learn button, its level lines up with the channels'
+    if (soloButton != nullptr)
+        soloButton->setBounds(
+            muteButton->getX() + buttonWidth - blankSpace / 2,			// x
+            blankSpace + panSlider->getY() + panSlider->getHeight(),											// y
+            buttonWidth,									// width
+            buttonHeight);								// height
 
-    midiLearnButton->setBounds
-    (midiLearnButton->getBoundsInParent().getX(),
-        blankSpace + muteButton->getY() + muteButton->getHeight(),
-        midiLearnButton->getParentWidth(),
-        buttonHeight);
+    auto learnY = blankSpace + muteButton->getY() + muteButton->getHeight();
+
+    if (midiLearnButton != nullptr)
+        midiLearnButton->setBounds
+        (midiLearnButton->getBoundsInParent().getX(),
+            learnY,
+            midiLearnButton->getParentWidth(),
+            buttonHeight);
 
     levelLabel->setBounds
     (levelLabel->getBoundsInParent().getX(),			// x
-        blankSpace + midiLearnButton->getBoundsInParent().getY() + midiLearnButton->getHeight(),						    // y
+        blankSpace + learnY + buttonHeight,						    // y
         levelLabel->getParentWidth(),									// width
         labelHeight);								// height
 
@@ -3,6 +3,7 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "../core/PluginProcessor.h"
 #include "../utils/DrumsetXmlHandler.h"
+#include "LevelMeterComponent.h"
 
 //==============================================================================
 
@@ -33,6 +34,7 @@ class  DrumEditor :
 public:
 
     DrumEditor(DrumProcessor& parent, AudioProcessorValueTreeState& vts);
+    ~DrumEditor();
 
     void paint(Graphics&) override;
     void resized() override;
@@ -84,11 +86,16 @@ private:
         Button* muteButton,
         Button* soloButton,
         Button* midiLearnButton,
-        SliderAttachment* levelAttachment,
-        SliderAttachment* panAttachment,
-        ButtonAttachment* muteAttachment,
-        ButtonAttachment* soloAttachment,
-        ButtonAttachment* midiLearnAttachment);
+        std::unique_ptr<SliderAttachment>* levelAttachment,
+        std::unique_ptr<SliderAttachment>* panAttachment,
+        std::unique_ptr<ButtonAttachment>* muteAttachment,
+        std::unique_ptr<ButtonAttachment>* soloAttachment,
+        std::unique_ptr<ButtonAttachment>* midiLearnAttachment);
+
+    /*
+    * Puts the meter beside the level slider of its channel group.
+    */
+    void placeMeter(Component& levelSlider, LevelMeterComponent& meter);
 
     void drawChannel(int startX,
         Component* group,
@@ -107,6 +114,36 @@ private:
 
     int numChannels, startingPoint = 5;
 
+    // Meters refresh at this rate from the processor's readings
+    static constexpr int meterRefreshHz = 60;
+
+    MeterSnapshot meterSnapshot;
+    Array<LevelMeterComponent*> channelMeters;
+
+    // Performance figures change slower than meters
+    static constexpr int performanceRefreshTicks = meterRefreshHz / 4;
+
+    /*
+    * Shows the performance counters summary in performanceLabel.
+    */
+    void updatePerformanceLabel();
+
+    Label performanceLabel;
+    int ticksSincePerformanceUpdate = 0;
+
+    /*
+    * Asks for a kit file and hands it to the processor.
+    */
+    void chooseKit();
+
+    /*
+    * Shows the kit playing, or that one is loading.
+    */
+    void updateKitButton();
+
+    TextButton kitButton;
+    std::unique_ptr<FileChooser> kitChooser;
+
     GroupComponent
         group1,
         group2,
@@ -239,5 +276,16 @@ private:
         midiLearnAttachment7,
         midiLearnAttachment8;
 
+    LevelMeterComponent
+        meter1,
+        meter2,
+        meter3,
+        meter4,
+        meter5,
+        meter6,
+        meter7,
+        meter8,
+        masterMeter;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumEditor)
 };
\ No newline at end of file
@@ -8,7 +8,7 @@ AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 
 AudioProcessorEditor* DrumProcessor::createEditor()
 {
-    return new GenericEditor(*this, parameters);
+    return new DrumEditor(*this, parameters);
 }
 
 AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
@@ -87,6 +87,16 @@ AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
         paramID.clear();
         paramID << "p" << curOut;
 
+        // Sum this channel into master too when it has its own output
+        params.add(std::make_unique<AudioParameterBool>
+            (paramID << "ToMaster",
+             curOut << " To Master",
+             true)
+        );
+        curOut = outputs[i];
+        paramID.clear();
+        paramID << "p" << curOut;
+
         params.add(std::make_unique<AudioParameterFloat>
             (paramID << "Coarse",
              curOut << " Coarse",
@@ -104,6 +114,20 @@ AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
         curOut = outputs[i];
         paramID.clear();
         paramID << "p" << curOut;
+
+        // Interpolation used to pitch this channel's samples
+        StringArray qualities;
+        for (auto mode = 0; mode < VoiceRenderKernel::numInterpolations; ++mode)
+            qualities.add(VoiceRenderKernel::getInterpolationName(mode));
+
+        params.add(std::make_unique<AudioParameterChoice>
+            (paramID << "Quality",
+             curOut << " Quality",
+             qualities, VoiceRenderKernel::linear)
+        );
+        curOut = outputs[i];
+        paramID.clear();
+        paramID << "p" << curOut;
     }
 
     return params;
@@ -124,38 +148,157 @@ static MidiBuffer filterMidiMessagesForChannel(const MidiBuffer& input, int chan
     return output;
 }
 
+/*
+* Master output plus one output per active channel,
+* disabled until the host enables it.
+*/
+static AudioProcessor::BusesProperties createBusesProperties()
+{
+    DrumsetXmlHandler drumsetInfo;
+    auto buses = AudioProcessor::BusesProperties()
+        .withOutput("Master", juce::AudioChannelSet::stereo(), true);
+
+    for (auto& name : drumsetInfo.getActiveOutputs())
+        buses = buses.withOutput(name, juce::AudioChannelSet::stereo(), false);
+
+    return buses;
+}
+
 //==============================================================================
 DrumProcessor::DrumProcessor()
-    : juce::AudioProcessor(BusesProperties()
-        .withOutput("Master", juce::AudioChannelSet::stereo(), true)
-        //.withOutput("Kick", AudioChannelSet::stereo(), false)
-        //.withOutput("Snare", AudioChannelSet::stereo(), false)
-        //.withOutput("Tom 1", AudioChannelSet::stereo(), false)
-        //.withOutput("Tom 2", AudioChannelSet::stereo(), false)
-        //.withOutput("Tom 3", AudioChannelSet::stereo(), false)
-        //.withOutput("HiHat", AudioChannelSet::stereo(), false)
-        //.withOutput("Overhead", AudioChannelSet::stereo(), false)
-    )
+    : juce::AudioProcessor(createBusesProperties())
     , parameters(*this, nullptr, juce::Identifier("DrumSamplerVTS"), createParameterLayout())
 {
     // Retrieve drumset info
     outputs = drumsetInfo.getActiveOutputs();
     maxOutputs = outputs.size();
-    int note = startNote;
+    numRenderThreads = drumsetInfo.getRenderThreads();
+
+    // Routing table keeps one bit per synth
+    jassert(maxOutputs <= DrumKit::maxChannels && maxOutputs <= MeterSnapshot::maxChannels);
 
-    // Generate a synth for each active output, then attach parameters
+    // Attach parameters of each slot, then build the kit
+    // of mixer_info.xml to play through them
     for (auto channel = 0; channel < maxOutputs; channel++)
     {
         DBG(outputs[channel]);
-        synth.add(new DrumSynth(parameters, outputs[channel], note++));
+        synthMidi.add(new MidiBuffer());
+        renderTargets.add(new RenderTarget());
+        channelMeters.add(new LevelMeter());
         attachChannelParams(channel);
     }
 
     attachMasterParams();
+
+    // Hosts may render before prepareToPlay: channels going
+    // nowhere still get scratch buffers for typical blocks
+    scratch.prepare(maxOutputs, 2, defaultBlockSize);
+
+    kit = new DrumKit(DrumsetXmlHandler::getDefaultKitFile(), outputs, parameters, streamer, loader, releaseQueue);
+    publishedKit = kit;
+
+    if (drumsetInfo.isPerformanceLogEnabled())
+        performance.setLogFile(getDefaultPerformanceLog());
+
+    performance.start();
+    releaseQueue.start();
+    rebuildMidiRouting();
+    updateAudibleChannels();
+    startTimer(learnCheckMs);
 }
 
 DrumProcessor::~DrumProcessor()
-{ }
+{
+    stopTimer();
+
+    for (auto& name : outputs)
+    {
+        parameters.removeParameterListener("p" + name + "Solo", this);
+        parameters.removeParameterListener("p" + name + "Mute", this);
+    }
+
+    // No kit is built past this point, and pending loads go;
+    // then synths unregister their voices from the streamer
+    kitLoader.stop();
+    loader.cancelAllJobs();
+
+    if (auto* unplayed = pendingKit.exchange(nullptr))
+        unplayed->decReferenceCount();
+
+    kit = nullptr;
+    fadingKit = nullptr;
+    publishedKit = nullptr;
+
+    // Frees the kits and buffers still waiting for it
+    releaseQueue.stop();
+}
+
+void DrumProcessor::setActiveVoiceListEnabled(bool shouldBeEnabled)
+{
+    // The kit played may be rendering: the audio thread
+    // hands the flag to it, and to every kit it swaps in
+    activeListEnabled = shouldBeEnabled;
+}
+
+void DrumProcessor::loadKit(const File& kitFile)
+{
+    // Saved with the session, so it comes back with it
+    parameters.state.setProperty("kitFile", kitFile.getFullPathName(), nullptr);
+    kitLoader.load(kitFile);
+}
+
+DrumKit::Ptr DrumProcessor::buildKit(const File& kitFile)
+{
+    if (!kitFile.existsAsFile())
+        return nullptr;
+
+    DrumKit::Ptr newKit = new DrumKit(kitFile, outputs, parameters, streamer, loader, releaseQueue);
+    return newKit->getNumChannels() > 0 ? newKit : nullptr;
+}
+
+void DrumProcessor::publishKit(DrumKit::Ptr newKit)
+{
+    const ScopedLock sl(kitLock);
+
+    if (preparedSampleRate > 0.0)
+        newKit->prepare(preparedSampleRate);
+
+    publishedKit = newKit;
+
+    // The reference taken here goes to the audio thread with the
+    // pointer; a kit it never took is dropped here instead
+    newKit->incReferenceCount();
+
+    if (auto* unplayed = pendingKit.exchange(newKit.get(), std::memory_order_acq_rel))
+        unplayed->decReferenceCount();
+}
+
+void DrumProcessor::swapKit()
+{
+    auto* next = pendingKit.exchange(nullptr, std::memory_order_acq_rel);
+
+    if (next == nullptr)
+        return;
+
+    // A kit still fading when the next one comes is cut short
+    if (fadingKit != nullptr)
+    {
+        for (auto* s : fadingKit->getSynths())
+            s->stopAllVoices();
+
+        releaseQueue.retire(fadingKit);
+    }
+
+    // Neither assignment drops a last reference: the old kit moves
+    // to fadingKit and the new one is held by kit before its
+    // handed over reference is given back
+    fadingKit = kit;
+    kit = next;
+    next->decReferenceCount();
+
+    fadingKit->fadeOut();
+    rebuildMidiRouting();
+}
 
 //==============================================================================
 void DrumProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
@@ -168,49 +311,56 @@ void DrumProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 
     auto lastSampleRate = sampleRate;
     outputs = drumsetInfo.getActiveOutputs();
-    prevGain = *level;
+    prevMasterGains[0] = *level * jmin(1.0f - pan->load(), 1.0f);
+    prevMasterGains[1] = *level * jmin(1.0f + pan->load(), 1.0f);
 
-    // Prepare outputs
-    for (auto midiChannel = 0; midiChannel < maxOutputs; ++midiChannel)
+    // Sample copies at the new rate are made in background.
+    // The kit played and the one published may differ
+    // until the next block swaps them
     {
-        synth[midiChannel]->setCurrentPlaybackSampleRate(lastSampleRate);
+        const ScopedLock sl(kitLock);
+        preparedSampleRate = lastSampleRate;
+        kit->prepare(lastSampleRate);
 
-        // If host changes block size while plugin is running,
-        // update size and recreate buffers with the new one.
-        if (pluginIsInit && lastBlockSize != samplesPerBlock)
-        {
-            buffers.clear();
-            buffersAllocated = false;
-        }
-
-        if (!buffersAllocated && sampleBlockInitCount == 0)
-        {
-            ReferenceCountedBuffer::Ptr newBuffer = new ReferenceCountedBuffer(outputs[midiChannel],
-                                                                               getMainBusNumOutputChannels(),
-                                                                               samplesPerBlock);
-            buffers.add(newBuffer);
-            lastBlockSize = samplesPerBlock;
-        }
+        if (publishedKit != kit)
+            publishedKit->prepare(lastSampleRate);
     }
 
-    // This method gets called 4 times.
-    // In the first 2 calls samplesPerBlock has an arbitrary value,
-    // then we wait for the later calls in order
-    // to get the actual block size from host.
-    if (sampleBlockInitCount > 0)
+    // Nothing is left playing from a kit switched before the stop
+    if (fadingKit != nullptr)
     {
-        sampleBlockInitCount--;
+        for (auto* s : fadingKit->getSynths())
+            s->stopAllVoices();
+
+        fadingKit = nullptr;
     }
-    else
+
+    // Each synth may get every event of the block: room for
+    // a few short events per sample, so routing never allocates
+    synthMidiCapacity = jmax(synthMidiCapacity, samplesPerBlock * (int) maxMidiEventsPerSample * (int) midiEventBytes);
+
+    // Prepare outputs
+    for (auto midiChannel = 0; midiChannel < maxOutputs; ++midiChannel)
     {
-        buffersAllocated = true;
-        pluginIsInit = true;
+        channelMeters[midiChannel]->prepare(lastSampleRate);
+        synthMidi[midiChannel]->ensureSize((size_t) synthMidiCapacity);
     }
+
+    masterMeter.prepare(lastSampleRate);
+
+    // Workers run only while the host is playing
+    renderPool.setNumWorkers(numRenderThreads - 1);
+
+    // One scratch buffer per synth, for any block up to samplesPerBlock.
+    // Hosts may call this several times with different sizes:
+    // the arena only grows, so nothing is freed while in use.
+    scratch.prepare(maxOutputs, jmax(2, getMainBusNumOutputChannels()), samplesPerBlock);
 }
 
 void DrumProcessor::releaseResources()
 {
     DBG("Releasing audio resources");
+    renderPool.setNumWorkers(0);
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -226,6 +376,15 @@ bool DrumProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
         && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
         return false;
 
+    // Channel outputs are mono, stereo or disabled
+    for (auto i = 1; i < layouts.outputBuses.size(); ++i)
+    {
+        auto& set = layouts.outputBuses.getReference(i);
+
+        if (!set.isDisabled() && set != AudioChannelSet::mono() && set != AudioChannelSet::stereo())
+            return false;
+    }
+
     // This checks if the input layout matches the output layout
 #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
@@ -240,82 +399,164 @@ bool DrumProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
 void DrumProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer& midiBuffer)
 {
     ScopedNoDenormals noDenormals;
-    auto totalNumOutputChannels = getMainBusNumOutputChannels();
+    auto blockStart = Time::getHighResolutionTicks();
     auto numSamples = buffer.getNumSamples();
-    auto numChannels = buffer.getNumChannels();
 
-    // Clear buffer before fill it
-    for (auto i = 0; i < totalNumOutputChannels; i++)
-        buffer.clear(i, 0, numSamples);
+    // Clear buffer before fill it, channel outputs included
+    buffer.clear();
+
+    auto master = getBusBuffer(buffer, false, 0);
+    auto numChannels = master.getNumChannels();
 
     // Copy param values
     auto isMuteEnabled = *muteEnabled > 0.5f ? true : false;
     auto curPan = pan->load();
     auto curGain = isMuteEnabled ? 0.0f : level->load();
 
-    if (buffersAllocated) // ignore synth buffers if not allocated yet
+    // A kit loaded in background takes over from here
+    if (pendingKit.load(std::memory_order_relaxed) != nullptr)
+        swapKit();
+
+    kit->setActiveListEnabled(activeListEnabled.load(std::memory_order_relaxed));
+
+    auto hasChokes = kit->hasChokes();
+
+    // Some synth may have learnt a new note in the last block
+    if (midiRoutingNeedsRebuild && (midiRoutingEnabled || hasChokes))
+        rebuildMidiRouting();
+
+    // A buffer larger than the synths' reserved space would
+    // allocate while copied: this block every synth reads it whole
+    auto routeMidi = midiRoutingEnabled && midiBuffer.data.size() <= synthMidiCapacity;
+
+    if (routeMidi)
+        routeMidiEvents(midiBuffer);
+    else if (midiRoutingEnabled)
+        midiRoutingNeedsRebuild = true;     // a synth may learn its note from it
+
+    if (hasChokes)
+        routeChokes(midiBuffer);
+
+    auto audible = audibleChannels.load();
+
+    // Rendered in parallel, channels get buffers of their own
+    // and are summed to master afterwards in channel order,
+    // so the mix doesn't depend on which thread rendered what
+    auto renderInParallel = renderPool.getNumWorkers() > 0 && maxOutputs > 1
+                            && numSamples <= scratch.getMaxBlockSize();
+
+    // Channel meters need each channel on its own too,
+    // so they only run while the editor shows them
+    auto isMetering = meteringEnabled.load(std::memory_order_relaxed);
+    auto renderApart = (renderInParallel || isMetering) && numSamples <= scratch.getMaxBlockSize();
+
+    // Pick where each synth renders
+    for (auto i = 0; i < maxOutputs; i++)
     {
-        checkForBuffersToFree();
+        // Muted and soloed out channels keep playing,
+        // their gains fade to silence
+        auto isAudible = (audible & (1u << i)) != 0;
 
-        // Fill each synth buffer
-        for (auto i = 0; i < maxOutputs; i++)
-        {
-            if (checkSoloEnabled() && !checkSoloChannel(i))
-            {
-                // apply gain ramp to zero
-                continue;
-            }
+        if (i < kit->getNumChannels())
+            kit->getSynth(i)->getChannelParameters().update(numSamples, isAudible);
+
+        if (fadingKit != nullptr && i < fadingKit->getNumChannels())
+            fadingKit->getSynth(i)->getChannelParameters().update(numSamples, isAudible);
 
-            currentBuffer = buffers[i];
+        // Pass midi messages to each synth so they can fill their buffer
+        auto& target = *renderTargets.getUnchecked(i);
+        target.midi = routeMidi ? synthMidi.getUnchecked(i) : &midiBuffer;
+        target.sumToMaster = toMasterChannels[i]->load() > 0.5f;
 
-            if (currentBuffer == nullptr)
-                jassertfalse; // currentBuffer has to exist. @todo: handle exception
+        auto* channelBus = getBus(false, i + 1);
+        target.hasOwnOutput = channelBus != nullptr && channelBus->isEnabled();
+        target.intoMaster = false;
+        target.metered = isMetering;
+
+        if (target.hasOwnOutput)
+        {
+            // Voices mix straight into the channel output,
+            // which is then summed to master if asked to
+            auto channelBuffer = getBusBuffer(buffer, false, i + 1);
+            target.buffer.setDataToReferTo(channelBuffer.getArrayOfWritePointers(), channelBuffer.getNumChannels(), numSamples);
+        }
+        else if (target.sumToMaster && !renderApart)
+        {
+            // No output of its own: mix straight into master
+            target.buffer.setDataToReferTo(master.getArrayOfWritePointers(), numChannels, numSamples);
+            target.intoMaster = true;
+        }
+        else
+        {
+            // Going nowhere, but voices have to keep playing,
+            // or rendering beside other channels.
+            // Blocks longer than announced in prepareToPlay
+            // break the host contract and get cut to the arena size.
+            jassert(numSamples <= scratch.getMaxBlockSize());
+            auto scratchBuffer = scratch.getBuffer(i, numSamples);
+            target.buffer.setDataToReferTo(scratchBuffer.getArrayOfWritePointers(),
+                                           scratchBuffer.getNumChannels(),
+                                           scratchBuffer.getNumSamples());
+        }
+    }
 
-            auto curBuffer = currentBuffer->getAudioSampleBuffer();
-            curBuffer->clear();
+    if (renderInParallel)
+        renderPool.run(*this, maxOutputs);
+    else
+        for (auto i = 0; i < maxOutputs; i++)
+            runTask(i);
 
-            // Pass midi messages to each synth so they can fill their buffer
-            synth[i]->renderNextBlock(*curBuffer, midiBuffer, 0, buffer.getNumSamples());
+    // Sum to master what wasn't rendered there
+    for (auto i = 0; i < maxOutputs; i++)
+    {
+        auto& target = *renderTargets.getUnchecked(i);
 
-            // Add to main output buffer
+        if (target.sumToMaster && !target.intoMaster)
             for (auto ch = 0; ch < numChannels; ch++)
-                buffer.addFrom(
-                    ch,
-                    0,
-                    curBuffer->getReadPointer(ch),
-                    numSamples
-                );
-        }
+                master.addFrom(ch, 0, target.buffer, jmin(ch, target.buffer.getNumChannels() - 1), 0, target.buffer.getNumSamples());
     }
 
-    // Write main buffer to output applying levels
-    float* outL = buffer.getWritePointer(0);
-    float* outR = numChannels > 1 ? buffer.getWritePointer(1) : nullptr;
+    // Write main buffer to output applying levels,
+    // pan and level in a single pass per channel
+    float masterGains[2] = { curGain * jmin(1.0f - curPan, 1.0f),
+                             curGain * jmin(1.0f + curPan, 1.0f) };
 
-    while (--numSamples >= 0)
+    for (auto ch = 0; ch < jmin(numChannels, 2); ++ch)
     {
-        if (outR != nullptr)
+        if (masterGains[ch] == prevMasterGains[ch])
         {
-            *outL++ *= jmin(1.0f - curPan, 1.0f);
-            *outR++ *= jmin(1.0f + curPan, 1.0f);
+            master.applyGain(ch, 0, numSamples, masterGains[ch]);
         }
         else
         {
-            *outL++ *= jmin(1.0f - curPan, 1.0f);
+            // Creates fades between audio blocks
+            // if level or pan params are changing
+            master.applyGainRamp(ch, 0, numSamples, prevMasterGains[ch], masterGains[ch]);
+            prevMasterGains[ch] = masterGains[ch];
         }
     }
 
-    if (curGain == prevGain)
-    {
-        buffer.applyGain(curGain);
-    }
-    else
+    if (isMetering)
     {
-        // Creates fades between audio blocks 
-        // if level param is changing
-        buffer.applyGainRamp(0, buffer.getNumSamples(), prevGain, curGain);
-        prevGain = curGain;
+        masterMeter.process(master, numSamples);
+        publishMeters();
     }
+
+    // Synths that learnt a note wait for learn to be turned off
+    uint32 learnt = 0;
+
+    for (auto i = 0; i < kit->getNumChannels(); i++)
+        if (kit->getSynth(i)->hasLearnt())
+            learnt |= (1u << i);
+
+    if (learnt != 0)
+        learntChannels.fetch_or(learnt, std::memory_order_relaxed);
+
+    // Freed off the audio thread once its voices are silent
+    if (fadingKit != nullptr && !fadingKit->isPlaying())
+        releaseQueue.retire(fadingKit);
+
+    recordBlock(numSamples, blockStart);
 }
 
 void DrumProcessor::getStateInformation(MemoryBlock& destData)
@@ -330,7 +571,15 @@ void DrumProcessor::setStateInformation(const void* data, int sizeInBytes)
     std::unique_ptr<XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(parameters.state.getType()))
+        {
             parameters.replaceState(ValueTree::fromXml(*xmlState));
+
+            // Back to the kit the session was saved with
+            File kitFile = parameters.state.getProperty("kitFile").toString();
+
+            if (kitFile.existsAsFile() && kitFile != getKit()->getFile())
+                loadKit(kitFile);
+        }
 }
 
 void DrumProcessor::attachMasterParams()
@@ -344,86 +593,216 @@ void DrumProcessor::attachChannelParams(int midiChannel)
 {
     String paramID;
 
-    // Channel params
+    // Level, pan, tuning, quality and learn are read
+    // by the synths of every kit playing in this slot
     auto channelName = outputs[midiChannel];
-    auto numVoices = synth[midiChannel]->getNumVoices();
 
-    if (numVoices != 0)
+    // Solo
+    paramID << "p" << channelName << "Solo";
+    soloChannels.set(midiChannel, parameters.getRawParameterValue(paramID));
+    parameters.addParameterListener(paramID, this);
+    paramID.clear();
+
+    // Mute
+    paramID << "p" << channelName << "Mute";
+    muteChannels.set(midiChannel, parameters.getRawParameterValue(paramID));
+    parameters.addParameterListener(paramID, this);
+    paramID.clear();
+
+    // To master
+    paramID << "p";
+    toMasterChannels.set(midiChannel, parameters.getRawParameterValue(paramID << channelName << "ToMaster"));
+    paramID.clear();
+
+    // Learn, turned off from the message thread once a note is learnt
+    paramID << "p" << channelName << "Learn";
+    learnParameters.set(midiChannel, parameters.getParameter(paramID));
+}
+
+void DrumProcessor::timerCallback()
+{
+    auto learnt = learntChannels.exchange(0);
+
+    for (auto i = 0; i < learnParameters.size(); i++)
+        if ((learnt & (1u << i)) != 0)
+            learnParameters.getUnchecked(i)->setValueNotifyingHost(0.0f);
+}
+
+void DrumProcessor::rebuildMidiRouting()
+{
+    std::fill(std::begin(noteRouting), std::end(noteRouting), 0u);
+
+    for (auto i = 0; i < kit->getNumChannels(); i++)
+        noteRouting[kit->getSynth(i)->getMidiNote() & 127] |= (1u << i);
+
+    midiRoutingNeedsRebuild = false;
+}
+
+void DrumProcessor::routeMidiEvents(const MidiBuffer& midiBuffer)
+{
+    uint32 learningSynths = 0;
+    uint32 allSynths = 0;
+
+    for (auto i = 0; i < maxOutputs; i++)
+        synthMidi.getUnchecked(i)->clear();
+
+    for (auto i = 0; i < kit->getNumChannels(); i++)
+    {
+        allSynths |= (1u << i);
+
+        if (kit->getSynth(i)->isLearning())
+            learningSynths |= (1u << i);
+    }
+
+    for (const auto metadata : midiBuffer)
+    {
+        // Look at the raw bytes, no need to build a MidiMessage
+        // just to find out which synths the event belongs to
+        auto status = metadata.numBytes > 0 ? (metadata.data[0] & 0xf0) : 0;
+        auto isNoteOn = status == 0x90 && metadata.numBytes > 2 && metadata.data[2] != 0;
+        auto isNoteOnOrOff = status == 0x80 || status == 0x90;
+        auto targets = allSynths;
+
+        if (isNoteOnOrOff && metadata.numBytes > 1)
+            targets = noteRouting[metadata.data[1] & 127] | (isNoteOn ? learningSynths : 0u);
+
+        for (auto i = 0; targets != 0; i++, targets >>= 1)
+            if ((targets & 1u) != 0)
+                synthMidi.getUnchecked(i)->addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
+    }
+
+    // Learning synths may change their note while rendering
+    if (learningSynths != 0)
+        midiRoutingNeedsRebuild = true;
+}
+
+void DrumProcessor::routeChokes(const MidiBuffer& midiBuffer)
+{
+    uint32 learningSynths = 0;
+
+    for (auto i = 0; i < kit->getNumChannels(); i++)
+        if (kit->getSynth(i)->isLearning())
+            learningSynths |= (1u << i);
+
+    for (const auto metadata : midiBuffer)
     {
-        for (auto i = 0; i < numVoices; i++)
+        auto isNoteOn = metadata.numBytes > 2 && (metadata.data[0] & 0xf0) == 0x90 && metadata.data[2] != 0;
+
+        if (!isNoteOn)
+            continue;
+
+        // Learning synths take the note without playing it
+        auto players = noteRouting[metadata.data[1] & 127] & ~learningSynths;
+
+        for (auto i = 0; players != 0; i++, players >>= 1)
         {
-            auto currentVoice = static_cast<DrumVoice*>(synth[midiChannel]->getVoice(i));
-            auto currentSoloChannel = soloChannels[midiChannel];
-            auto sampleRate = currentVoice->getSampleRate();
-
-            // Level
-            paramID << "p";
-            currentVoice->level = parameters.getRawParameterValue(paramID << channelName << "Level");
-            paramID.clear();
-
-            // Pan
-            paramID << "p";
-            currentVoice->pan = parameters.getRawParameterValue(paramID << channelName << "Pan");
-            paramID.clear();
-
-            // Mute
-            paramID << "p";
-            currentVoice->muteEnabled = parameters.getRawParameterValue(paramID << channelName << "Mute");
-            paramID.clear();
-
-            // Learn
-            paramID << "p";
-            synth[midiChannel]->attachMidiLearn(parameters.getRawParameterValue(paramID << channelName << "Learn"));
-            paramID.clear();
-
-            // Coarse
-            paramID << "p";
-            currentVoice->coarse = parameters.getRawParameterValue(paramID << channelName << "Coarse");
-            paramID.clear();
-
-            // Fine
-            paramID << "p";
-            currentVoice->fine = parameters.getRawParameterValue(paramID << channelName << "Fine");
-            paramID.clear();
+            if ((players & 1u) == 0)
+                continue;
+
+            auto targets = kit->getChokeTargets(i);
+
+            for (auto j = 0; targets != 0; j++, targets >>= 1)
+                if ((targets & 1u) != 0)
+                    kit->getSynth(j)->addChoke(metadata.samplePosition);
         }
     }
+
+    if (learningSynths != 0)
+        midiRoutingNeedsRebuild = true;
 }
 
-void DrumProcessor::checkForBuffersToFree()
+void DrumProcessor::runTask(int index)
 {
-    // Iterate in reverse to avoid corrupting the array index access if we remove items
-    for (auto i = buffers.size(); --i >= 0;)
+    auto& target = *renderTargets.getUnchecked(index);
+    auto renderStart = Time::getHighResolutionTicks();
+
+    // Slots past the end of the kit only play what the old kit fades out
+    if (index < kit->getNumChannels())
+        kit->getSynth(index)->renderBlock(target.buffer, *target.midi, 0, target.buffer.getNumSamples());
+
+    if (fadingKit != nullptr && index < fadingKit->getNumChannels())
+        fadingKit->getSynth(index)->renderBlock(target.buffer, noMidi, 0, target.buffer.getNumSamples());
+
+    // Metered where it rendered, on whichever thread that is;
+    // a channel mixed into master keeps its last reading
+    if (target.metered && !target.intoMaster)
+        channelMeters.getUnchecked(index)->process(target.buffer, target.buffer.getNumSamples());
+
+    target.renderTicks = Time::getHighResolutionTicks() - renderStart;
+}
+
+void DrumProcessor::recordBlock(int numSamples, int64 blockStart)
+{
+    auto& record = blockRecord;
+    record.blockIndex = numBlocksProcessed++;
+    record.numSamples = numSamples;
+    record.budgetMicros = preparedSampleRate > 0.0 ? (float) (1.0e6 * numSamples / preparedSampleRate) : 0.0f;
+    record.activeVoices = 0;
+    record.droppedNotes = 0;
+    record.streamUnderruns = 0;
+    record.loaderQueue = loader.getNumPendingJobs();
+    record.releaseQueue = releaseQueue.getNumPending();
+    record.numChannels = jmin(maxOutputs, (int) PerformanceCounters::maxChannels);
+
+    for (auto* s : kit->getSynths())
     {
-        ReferenceCountedBuffer::Ptr buffer (buffers.getUnchecked (i));
+        record.activeVoices += s->getNumActiveVoices();
+        record.droppedNotes += s->takeDroppedNotes();
+        record.streamUnderruns += s->takeUnderruns();
+    }
 
-        if (buffer->getReferenceCount() == 2)
-            buffers.remove (i);
+    if (fadingKit != nullptr)
+    {
+        for (auto* s : fadingKit->getSynths())
+        {
+            record.activeVoices += s->getNumActiveVoices();
+            record.streamUnderruns += s->takeUnderruns();
+        }
     }
+
+    for (auto i = 0; i < record.numChannels; i++)
+        record.channelMicros[i] = (float) (1.0e6 * Time::highResolutionTicksToSeconds(renderTargets.getUnchecked(i)->renderTicks));
+
+    // Stopped last, so the block time covers recording too
+    record.blockMicros = (float) (1.0e6 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - blockStart));
+    performance.push(record);
 }
 
-bool DrumProcessor::checkSoloEnabled()
+void DrumProcessor::publishMeters()
 {
+    auto& snapshot = meterExchange.getWriteSnapshot();
+    snapshot.numChannels = maxOutputs;
 
-    // Check if solo is enabled
-    for (auto index = 0; index < maxOutputs; index++)
+    for (auto ch = 0; ch < LevelMeter::maxChannels; ch++)
     {
-        juce::String paramId = "p";
-        auto value = parameters.getRawParameterValue(paramId << outputs[index] << "Solo");
+        snapshot.master[ch] = masterMeter.getReading(ch);
 
-        //auto value = ch->load();
-        if (value->load() > 0.5f)
-            return true;
+        for (auto i = 0; i < maxOutputs; i++)
+            snapshot.channels[i][ch] = channelMeters.getUnchecked(i)->getReading(ch);
     }
 
-    return false;
+    meterExchange.publish();
 }
 
-bool DrumProcessor::checkSoloChannel(int index)
+void DrumProcessor::updateAudibleChannels()
 {
-    juce::String paramId = "p";
-    auto value = parameters.getRawParameterValue(paramId << outputs[index] << "Solo");
-    if (value->load() > 0.5f)
-        return true;
+    uint32 soloed = 0, muted = 0;
+
+    for (auto index = 0; index < maxOutputs; index++)
+    {
+        if (soloChannels[index]->load() > 0.5f)
+            soloed |= (1u << index);
 
-    return false;
+        if (muteChannels[index]->load() > 0.5f)
+            muted |= (1u << index);
+    }
+
+    // With no solo every channel is audible
+    auto allChannels = maxOutputs < 32 ? (1u << maxOutputs) - 1u : ~0u;
+    audibleChannels = (soloed != 0 ? soloed : allChannels) & ~muted;
+}
+
+void DrumProcessor::parameterChanged(const String&, float)
+{
+    updateAudibleChannels();
 }
@@ -3,16 +3,29 @@
 #include <JuceHeader.h>
 #include "../core/PluginEditor.h"
 #include "DrumSynth.h"
+#include "DrumKit.h"
 #include "../utils/DrumsetXmlHandler.h"
 #include "../utils/ReferenceCountedBuffer.h"
+#include "../utils/ScratchArena.h"
+#include "../utils/SampleStreamer.h"
+#include "../utils/SampleLoader.h"
+#include "../utils/RenderWorkerPool.h"
+#include "../utils/SnapshotExchange.h"
+#include "../utils/PerformanceCounters.h"
+#include "../utils/ReleaseQueue.h"
+#include "../dsp/LevelMeter.h"
 
-class DrumProcessor : public AudioProcessor
+class DrumProcessor
+    : public AudioProcessor
+    , private AudioProcessorValueTreeState::Listener
+    , private RenderWorkerPool::Job
+    , private Timer
 {
 public:
     enum PluginOptions
     {
         maxMidiChannel = 8,
-        startNote = 72
+        startNote = DrumKit::firstNote
     };
 
     DrumProcessor();
@@ -46,10 +59,96 @@ public:
     void getStateInformation(MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
-    bool canAddBus(bool isInput) const override { return (!isInput && getBusCount(false) < maxMidiChannel); }
-    bool canRemoveBus(bool isInput) const override { return (!isInput && getBusCount(false) > 1); }
+    // One output per channel, fixed by mixer_info.xml
+    bool canAddBus(bool isInput) const override { return false; }
+    bool canRemoveBus(bool isInput) const override { return false; }
 
-    juce::OwnedArray<DrumSynth> synth;
+    /*
+    * Enables or disables the note-to-synth routing table.
+    * When disabled every synth receives the whole midi buffer.
+    * Used by the benchmark to compare both paths.
+    */
+    void setMidiRoutingEnabled(bool shouldBeEnabled)
+    {
+        midiRoutingEnabled = shouldBeEnabled;
+        midiRoutingNeedsRebuild = true;
+    }
+
+    /*
+    * Enables or disables rendering only the active voices of each synth,
+    * from the next block. Used by the benchmark to compare both paths.
+    */
+    void setActiveVoiceListEnabled(bool shouldBeEnabled);
+
+    /*
+    * Sets how many threads render channels, the audio thread
+    * included: 1 renders every channel on the audio thread.
+    * Takes effect on the next prepareToPlay.
+    */
+    void setNumRenderThreads(int numThreads) { numRenderThreads = jlimit(1, RenderWorkerPool::maxWorkers + 1, numThreads); }
+
+    /*
+    * Enables or disables the channel and master meters.
+    * Off by default: metered channels render apart from master,
+    * so the editor turns them on only while it shows them.
+    * The benchmark uses it to measure what metering costs.
+    */
+    void setMeteringEnabled(bool shouldBeEnabled) { meteringEnabled = shouldBeEnabled; }
+
+    /*
+    * Copies the latest meter readings into dest and returns
+    * true if they changed since the last call.
+    * Never blocks; called from the editor only.
+    */
+    bool readMeters(MeterSnapshot& dest) { return meterExchange.read(dest); }
+
+    /*
+    * Returns the counters of what each block cost,
+    * to show them or log them to a file.
+    */
+    PerformanceCounters& getPerformanceCounters() { return performance; }
+
+    /*
+    * Returns where the performance log goes when the
+    * performanceLog attribute of mixer_info.xml is set.
+    */
+    static File getDefaultPerformanceLog()
+    {
+        return File::getSpecialLocation(File::userApplicationDataDirectory)
+            .getChildFile("DrumSampler/PerformanceLog")
+            .getChildFile(Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") + ".csv");
+    }
+
+    /*
+    * Returns the loader reading samples for every synth.
+    */
+    SampleLoader& getSampleLoader() { return loader; }
+
+    /*
+    * Builds the kit described by the given file, laid out as
+    * mixer_info.xml, in background and switches to it once its
+    * samples are in memory; voices of the old kit fade out.
+    * Its channels take the slots of mixer_info.xml in order.
+    * Called from the message thread.
+    */
+    void loadKit(const File& kitFile);
+
+    /*
+    * Returns true while a kit asked for is still loading.
+    */
+    bool isKitLoading() const { return kitLoader.isLoading(); }
+
+    /*
+    * Returns the last kit handed to the audio thread.
+    * Not for the audio thread.
+    */
+    DrumKit::Ptr getKit() const
+    {
+        const ScopedLock sl(kitLock);
+        return publishedKit;
+    }
+
+    // Channel slots, fixed by mixer_info.xml
     juce::StringArray outputs;
 
 private:
@@ -66,38 +165,164 @@ private:
     void attachChannelParams(int i);
 
     /*
-    * Returns true if the channel at the given
-    * index has solo enabled, false otherwise.
+    * Recomputes audibleChannels from the solo and mute
+    * parameters of every channel.
     */
-    bool checkSoloChannel(int index);
+    void updateAudibleChannels();
+
+    // Called by solo and mute parameters, from any thread
+    void parameterChanged(const String& parameterID, float newValue) override;
+
+    // Renders the synth at the given index into its target,
+    // on the audio thread or a render worker
+    void runTask(int index) override;
 
     /*
-    * Returns true if solo is enabled on some channel,
-    * false otherwise.
+    * Rebuilds the note-to-synth routing table
+    * from each synth's current midi note.
     */
-    bool checkSoloEnabled();
-    // Check if there are buffers to free
-    void checkForBuffersToFree();
+    void rebuildMidiRouting();
 
+    /*
+    * Walks the host midi buffer once and copies each event
+    * to the midi buffer of the synths it belongs to.
+    * Note events go to the synths mapped to that note
+    * (plus the ones waiting for midi learn), any other
+    * event is sent to every synth.
+    */
+    void routeMidiEvents(const MidiBuffer& midiBuffer);
 
-    juce::ReferenceCountedArray<ReferenceCountedBuffer> buffers;
-    ReferenceCountedBuffer::Ptr currentBuffer;
+    /*
+    * Queues on the synths a choke at each note-on of a channel
+    * that chokes them, before any synth renders, so a channel
+    * can choke another one rendered on a different thread.
+    */
+    void routeChokes(const MidiBuffer& midiBuffer);
+
+    /*
+    * Builds the kit of the given file on the kit loader thread,
+    * or returns nullptr if the file has no channel to play.
+    */
+    DrumKit::Ptr buildKit(const File& kitFile);
+
+    /*
+    * Prepares a loaded kit and hands it to the audio thread.
+    * Called from the kit loader thread.
+    */
+    void publishKit(DrumKit::Ptr newKit);
+
+    /*
+    * Takes the kit published last and fades out the one it
+    * replaces. Called from the audio thread at block start.
+    */
+    void swapKit();
+
+    /*
+    * Where a synth renders the current block.
+    */
+    struct RenderTarget
+    {
+        AudioBuffer<float> buffer;
+        const MidiBuffer* midi = nullptr;
+        bool hasOwnOutput = false;
+        bool sumToMaster = true;
+        bool intoMaster = false;
+        bool metered = false;
+        int64 renderTicks = 0;
+    };
+
+    /*
+    * Pushes what the block cost to the performance counters.
+    */
+    void recordBlock(int numSamples, int64 blockStart);
+
+    /*
+    * Hands the readings of every meter to the editor.
+    */
+    void publishMeters();
+
+    /*
+    * Turns learn off for the channels that learnt a note.
+    * The audio thread only flags them in learntChannels.
+    */
+    void timerCallback() override;
+
+    enum
+    {
+        defaultBlockSize = 1024,    // scratch arena size until prepareToPlay
+        learnCheckMs = 50
+    };
+
+    ScratchArena scratch;
+    juce::OwnedArray<RenderTarget> renderTargets;
+    RenderWorkerPool renderPool;
+    int numRenderThreads = 1;
+    juce::OwnedArray<LevelMeter> channelMeters;
+    LevelMeter masterMeter;
+    SnapshotExchange<MeterSnapshot> meterExchange;
+    std::atomic<bool> meteringEnabled { false };
+    PerformanceCounters performance;
+    PerformanceCounters::BlockRecord blockRecord;
+    int64 numBlocksProcessed = 0;
+    juce::OwnedArray<MidiBuffer> synthMidi;
+    SampleStreamer streamer;
+    SampleLoader loader;
+    ReleaseQueue releaseQueue { streamer };     // frees what voices retire, off the audio thread
     juce::AudioProcessorValueTreeState parameters;
     DrumsetXmlHandler drumsetInfo;
     //UndoManager undoManager;
     Array<std::atomic<float>*> soloChannels;
+    Array<std::atomic<float>*> muteChannels;
+    Array<std::atomic<float>*> toMasterChannels;
+    Array<RangedAudioParameter*> learnParameters;
+
+    // Bit i is set once channel i has learnt its note
+    std::atomic<uint32> learntChannels { 0 };
     int maxOutputs;
-    bool buffersAllocated = false;
-    bool pluginIsInit = false;
-    int sampleBlockInitCount = 2;
+    double preparedSampleRate = 0.0;
+
+    // Bit i of noteRouting[n] is set if synth i plays note n
+    uint32 noteRouting[128] = {};
+    bool midiRoutingEnabled = true;
+    bool midiRoutingNeedsRebuild = false;
+
+    // Bytes reserved in each synth's midi buffer
+    enum
+    {
+        maxMidiEventsPerSample = 4,
+        midiEventBytes = sizeof(int32) + sizeof(uint16) + 3     // position, size and a short message
+    };
+
+    int synthMidiCapacity = 0;
+
+    // Kit the audio thread plays, and the one fading out
+    // after a switch until its voices are silent
+    DrumKit::Ptr kit;
+    DrumKit::Ptr fadingKit;
+    MidiBuffer noMidi;
+
+    // Next kit to play, with a reference the audio thread takes over
+    std::atomic<DrumKit*> pendingKit { nullptr };
+
+    // Last kit published, guarded for the message thread
+    CriticalSection kitLock;
+    DrumKit::Ptr publishedKit;
+
+    // Applied by the audio thread to the kit it plays
+    std::atomic<bool> activeListEnabled { true };
+
+    KitLoader kitLoader { [this] (const File& f) { return buildKit(f); },
+                          [this] (DrumKit::Ptr k) { publishKit(k); } };
+
+    // Bit i is set if channel i is neither muted nor soloed out
+    std::atomic<uint32> audibleChannels { ~0u };
 
     // Pointers to parameters, used by processor
     std::atomic<float>* level = nullptr;
     std::atomic<float>* pan = nullptr;
     std::atomic<float>* muteEnabled = nullptr;
 
-    float prevGain;
-    int lastBlockSize;
+    float prevMasterGains[2] = { 1.0f, 1.0f };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumProcessor)
 };
\ No newline at end of file
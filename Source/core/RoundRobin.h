@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "VelocityLayerTable.h"
+
+/*
+* Chooses which sample of a velocity layer a note-on plays,
+* so repeated hits alternate between round-robin recordings.
+*
+* All state sits in fixed arrays sized for the most layers
+* a synth can have, so a choice costs a few instructions and
+* is only ever made from the audio thread, without a lock.
+*/
+class RoundRobin
+{
+public:
+    enum Mode
+    {
+        cycle = 0,          // each layer plays its samples in order
+        random,             // a random sample, never the one just played
+        perNote,            // in order, one counter per note shared by all layers
+        numModes
+    };
+
+    enum
+    {
+        maxLayers = VelocityLayerTable::maxLayers,
+        numNotes = 128,
+        seed = 0x7e55
+    };
+
+    static String getModeName(Mode mode)
+    {
+        switch (mode)
+        {
+            case cycle:     return "cycle";
+            case random:    return "random";
+            case perNote:   return "perNote";
+            default:        return {};
+        }
+    }
+
+    /*
+    * Returns the mode with the given name, or
+    * defaultMode if the name is unknown.
+    */
+    static Mode getModeFromName(const String& name, Mode defaultMode)
+    {
+        for (auto i = 0; i < numModes; ++i)
+            if (name.equalsIgnoreCase(getModeName((Mode) i)))
+                return (Mode) i;
+
+        return defaultMode;
+    }
+
+    RoundRobin() { reset(); }
+
+    /*
+    * Sets how samples are chosen and starts every layer over.
+    * Must not be called while rendering.
+    */
+    void setMode(Mode newMode)
+    {
+        mode = newMode;
+        reset();
+    }
+
+    Mode getMode() const { return mode; }
+
+    /*
+    * Starts every layer and note from its first sample.
+    * The random sequence is seeded the same way each time,
+    * so a render can be repeated.
+    */
+    void reset()
+    {
+        std::fill(std::begin(nextInLayer), std::end(nextInLayer), 0);
+        std::fill(std::begin(lastInLayer), std::end(lastInLayer), -1);
+        std::fill(std::begin(noteCounters), std::end(noteCounters), 0u);
+        generator.setSeed(seed);
+    }
+
+    /*
+    * Returns the sample, in [0, numSamples), that the next hit
+    * of the given note on the given layer plays.
+    */
+    int choose(int layer, int midiNote, int numSamples)
+    {
+        jassert(isPositiveAndBelow(layer, (int) maxLayers) && isPositiveAndBelow(midiNote, (int) numNotes));
+
+        if (numSamples < 2)
+            return 0;
+
+        switch (mode)
+        {
+            case random:
+            {
+                // Draws among the others, skipping over the last one
+                auto last = lastInLayer[layer];
+                auto chosen = generator.nextInt(last < 0 ? numSamples : numSamples - 1);
+
+                if (last >= 0 && chosen >= last)
+                    ++chosen;
+
+                lastInLayer[layer] = chosen;
+                return chosen;
+            }
+
+            case perNote:
+                return (int) (noteCounters[midiNote]++ % (uint32) numSamples);
+
+            case cycle:
+            default:
+            {
+                auto chosen = nextInLayer[layer];
+
+                if (chosen >= numSamples)
+                    chosen = 0;
+
+                nextInLayer[layer] = chosen + 1;
+                return chosen;
+            }
+        }
+    }
+
+private:
+    Mode mode = cycle;
+    int nextInLayer[maxLayers];
+    int lastInLayer[maxLayers];
+    uint32 noteCounters[numNotes];
+    Random generator { (int64) seed };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RoundRobin)
+};
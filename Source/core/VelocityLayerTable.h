@@ -0,0 +1,101 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Maps each midi velocity of the note a synth plays
+* to the velocity layers it triggers, so a note-on finds
+* its sounds with one lookup instead of testing every one.
+*
+* Entries are filled testing each layer's float range on the
+* velocity a midi message gives, so they match Range::contains
+* exactly; velocities that aren't a midi value fall back to
+* testing the ranges.
+*
+* Rebuilt into the table not in use, which is then published
+* at once: a lookup sees either the old mapping or the new one.
+* A rebuild only reuses the older table, so rebuilds must not
+* come faster than lookups finish: here both happen on the audio
+* thread (midi learn) or before it starts.
+*/
+class VelocityLayerTable
+{
+public:
+    enum
+    {
+        maxLayers = 32,
+        numVelocities = 128
+    };
+
+    VelocityLayerTable() { }
+
+    /*
+    * Maps the given note to the layers whose velocity ranges
+    * are given, in layer order. Doesn't allocate.
+    */
+    void rebuild(int midiNote, const Range<float>* layerRanges, int numLayers)
+    {
+        jassert(numLayers <= maxLayers);
+
+        auto next = 1 - current.load(std::memory_order_relaxed);
+        auto& table = tables[next];
+
+        table.note = midiNote;
+        table.numLayers = jmin(numLayers, (int) maxLayers);
+
+        for (auto l = 0; l < table.numLayers; ++l)
+            table.ranges[l] = layerRanges[l];
+
+        for (auto v = 0; v < numVelocities; ++v)
+            table.layers[v] = findLayers(table, toFloatVelocity(v));
+
+        current.store(next, std::memory_order_release);
+    }
+
+    /*
+    * Returns a mask with bit n set if layer n applies to
+    * the given note and velocity.
+    */
+    uint32 getLayers(int midiNote, float velocity) const
+    {
+        auto& table = tables[current.load(std::memory_order_acquire)];
+
+        if (midiNote != table.note)
+            return 0;
+
+        auto index = roundToInt(velocity * 127.0f);
+
+        if (isPositiveAndBelow(index, (int) numVelocities) && toFloatVelocity(index) == velocity)
+            return table.layers[index];
+
+        return findLayers(table, velocity);
+    }
+
+private:
+    struct Table
+    {
+        int note = -1;
+        int numLayers = 0;
+        Range<float> ranges[maxLayers];
+        uint32 layers[numVelocities] = {};
+    };
+
+    // Same as MidiMessage::getFloatVelocity
+    static float toFloatVelocity(int velocity) { return (float) velocity * (1.0f / 127.0f); }
+
+    static uint32 findLayers(const Table& table, float velocity)
+    {
+        uint32 layers = 0;
+
+        for (auto l = 0; l < table.numLayers; ++l)
+            if (table.ranges[l].contains(velocity))
+                layers |= (uint32) 1 << l;
+
+        return layers;
+    }
+
+    Table tables[2];
+    std::atomic<int> current { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VelocityLayerTable)
+};
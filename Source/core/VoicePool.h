@@ -0,0 +1,237 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DrumSound.h"
+
+/*
+* Voice allocation for a DrumSynth.
+*
+* Free voices sit on a stack, so a note-on takes one in O(1)
+* instead of scanning every voice. Playing voices are kept in
+* start order, which is what stealing the oldest one needs.
+* A stolen voice is choked, fading out over a few milliseconds,
+* while one of a few spare voices plays the new note; spares
+* are given back first as voices finish.
+* Everything is preallocated when the voices are added and only
+* ever touched from the audio thread, so there's no lock.
+*/
+class VoicePool
+{
+public:
+    /*
+    * What to do when a note-on finds every voice busy.
+    */
+    enum StealingPolicy
+    {
+        none = 0,           // drop the new note
+        oldest,             // fade out the voice started first
+        quietest,           // fade out the voice with the lowest level
+        sameArticulation,   // fade out the oldest voice playing the same sample, else the oldest
+        numStealingPolicies
+    };
+
+    static String getPolicyName(StealingPolicy policy)
+    {
+        switch (policy)
+        {
+            case none:              return "none";
+            case oldest:            return "oldest";
+            case quietest:          return "quietest";
+            case sameArticulation:  return "sameArticulation";
+            default:                return {};
+        }
+    }
+
+    /*
+    * Returns the policy with the given name, or
+    * defaultPolicy if the name is unknown.
+    */
+    static StealingPolicy getPolicyFromName(const String& name, StealingPolicy defaultPolicy)
+    {
+        for (auto i = 0; i < numStealingPolicies; ++i)
+            if (name.equalsIgnoreCase(getPolicyName((StealingPolicy) i)))
+                return (StealingPolicy) i;
+
+        return defaultPolicy;
+    }
+
+    VoicePool() { }
+
+    /*
+    * Takes the given voices, all of them free, keeping the
+    * last numSpares of them to play notes that steal a voice.
+    * Must not be called while rendering.
+    */
+    void setVoices(const Array<DrumVoice*>& voicesToUse, int numSparesToKeep)
+    {
+        numVoices = voicesToUse.size();
+        numSpares = jlimit(0, numVoices, numSparesToKeep);
+        freeVoices.allocate((size_t) numVoices, true);
+        spareVoices.allocate((size_t) jmax(1, numSpares), true);
+        activeVoices.allocate((size_t) numVoices, true);
+        numFree = 0;
+        numSpare = 0;
+        numActive = 0;
+
+        for (auto i = numVoices; --i >= numVoices - numSpares;)
+            spareVoices[numSpare++] = voicesToUse.getUnchecked(i);
+
+        // Pushed in reverse, so the first voices are used first
+        for (auto i = numVoices - numSpares; --i >= 0;)
+            freeVoices[numFree++] = voicesToUse.getUnchecked(i);
+    }
+
+    void setStealingPolicy(StealingPolicy newPolicy) { policy = newPolicy; }
+
+    StealingPolicy getStealingPolicy() const { return policy; }
+
+    /*
+    * Returns a voice to play the given sound from the given
+    * sample of the block: a free one if any, otherwise one
+    * freed by stealing following the policy.
+    * Returns nullptr if the note has to be dropped.
+    */
+    DrumVoice* allocate(DrumSound* sound, int sampleInBlock)
+    {
+        if (numFree == 0)
+            releaseFinished();
+
+        auto* voice = numFree > 0 ? freeVoices[--numFree]
+                                  : stealVoice(sound, sampleInBlock);
+
+        if (voice != nullptr)
+            activeVoices[numActive++] = voice;
+
+        return voice;
+    }
+
+    /*
+    * Gives back to the free stack every voice that has
+    * stopped playing, keeping the others in start order.
+    */
+    void releaseFinished()
+    {
+        auto numStillActive = 0;
+
+        for (auto i = 0; i < numActive; ++i)
+        {
+            auto* voice = activeVoices[i];
+
+            if (voice->isVoiceActive())
+                activeVoices[numStillActive++] = voice;
+            else if (numSpare < numSpares)
+                spareVoices[numSpare++] = voice;
+            else
+                freeVoices[numFree++] = voice;
+        }
+
+        numActive = numStillActive;
+    }
+
+    /*
+    * Voices started and not yet given back, oldest first.
+    * Some of them may have stopped since the last releaseFinished().
+    */
+    DrumVoice* const* getActiveVoices() const { return activeVoices; }
+
+    int getNumActive() const { return numActive; }
+
+    int getNumVoices() const { return numVoices; }
+
+private:
+    /*
+    * Chokes the voice chosen by the policy from the given sample
+    * and returns a spare to play the new note, so the victim fades
+    * out instead of being cut. With no spare left the victim is
+    * stopped and returned. Returns nullptr if the note is dropped.
+    */
+    DrumVoice* stealVoice(DrumSound* sound, int sampleInBlock)
+    {
+        if (policy == none)
+            return nullptr;
+
+        auto victim = chooseVictim(sound);
+
+        if (numSpare > 0)
+        {
+            // Every voice already fading: the spare just adds to them
+            if (victim >= 0)
+                activeVoices[victim]->choke(sampleInBlock);
+
+            return spareVoices[--numSpare];
+        }
+
+        if (victim < 0)
+            return nullptr;
+
+        auto* voice = activeVoices[victim];
+        voice->stopNote(0.0f, false);
+
+        for (auto i = victim; i < numActive - 1; ++i)
+            activeVoices[i] = activeVoices[i + 1];
+
+        --numActive;
+
+        return voice;
+    }
+
+    /*
+    * Returns the index in activeVoices of the voice the policy
+    * steals, or -1 if there's none. Voices already fading out
+    * are left alone: they'll be free soon anyway.
+    */
+    int chooseVictim(DrumSound* sound) const
+    {
+        auto victim = -1;
+
+        switch (policy)
+        {
+            case oldest:
+                for (auto i = 0; i < numActive && victim < 0; ++i)
+                    if (!activeVoices[i]->isChoked())
+                        victim = i;
+                break;
+
+            case quietest:
+            {
+                auto lowest = std::numeric_limits<float>::max();
+
+                for (auto i = 0; i < numActive; ++i)
+                {
+                    if (activeVoices[i]->isChoked())
+                        continue;
+
+                    auto level = activeVoices[i]->getLevelEstimate();
+
+                    if (level < lowest)
+                    {
+                        lowest = level;
+                        victim = i;
+                    }
+                }
+                break;
+            }
+
+            case sameArticulation:
+                for (auto i = 0; i < numActive && victim < 0; ++i)
+                    if (!activeVoices[i]->isChoked() && activeVoices[i]->getCurrentlyPlayingSound().get() == sound)
+                        victim = i;
+
+                for (auto i = 0; i < numActive && victim < 0; ++i)
+                    if (!activeVoices[i]->isChoked())
+                        victim = i;
+                break;
+
+            default:
+                break;
+        }
+
+        return victim;
+    }
+
+    HeapBlock<DrumVoice*> freeVoices, spareVoices, activeVoices;
+    int numVoices = 0, numSpares = 0, numFree = 0, numSpare = 0, numActive = 0;
+    StealingPolicy policy = oldest;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoicePool)
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Peak, RMS and true peak meter of a stereo signal,
+* fed one block at a time on the audio thread.
+*
+* Peak is the largest sample, held and falling at a fixed
+* rate in dB so short hits stay visible between readings.
+* RMS is averaged over a few hundred milliseconds.
+* True peak also looks between samples, 4 times oversampled
+* by a windowed sinc filter as ITU-R BS.1770 describes, so
+* it catches the overs a converter would make of the signal.
+*
+* Reductions run on SIMD registers and FloatVectorOperations;
+* no state is allocated after construction.
+*/
+class LevelMeter
+{
+public:
+    enum
+    {
+        maxChannels = 2,
+        oversampling = 4,
+        tapsPerPhase = 12
+    };
+
+    struct Reading
+    {
+        float peak = 0.0f;
+        float rms = 0.0f;
+        float truePeak = 0.0f;
+    };
+
+    LevelMeter()
+    {
+        // Builds the shared filter now rather than on the audio thread
+        getFilter();
+        reset();
+    }
+
+    /*
+    * Sets the fall and averaging times for the given rate.
+    */
+    void prepare(double sampleRate)
+    {
+        peakFallPerSample = (float) (std::log(Decibels::decibelsToGain(-peakFallDbPerSecond)) / sampleRate);
+        rmsDecayPerSample = (float) (-1.0 / (rmsSeconds * sampleRate));
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& state : channels)
+        {
+            state.reading = {};
+            state.meanSquare = 0.0f;
+            state.historyPosition = 0;
+            std::fill(std::begin(state.history), std::end(state.history), 0.0f);
+        }
+    }
+
+    /*
+    * Measures the first numSamples of the buffer.
+    * A mono buffer reads the same on both channels.
+    */
+    void process(const AudioBuffer<float>& buffer, int numSamples)
+    {
+        numSamples = jmin(numSamples, buffer.getNumSamples());
+
+        if (numSamples <= 0 || buffer.getNumChannels() == 0)
+            return;
+
+        auto peakFall = std::exp(peakFallPerSample * (float) numSamples);
+        auto rmsAlpha = 1.0f - std::exp(rmsDecayPerSample * (float) numSamples);
+
+        for (auto ch = 0; ch < maxChannels; ++ch)
+        {
+            auto& state = channels[ch];
+            auto* data = buffer.getReadPointer(jmin(ch, buffer.getNumChannels() - 1));
+
+            auto range = FloatVectorOperations::findMinAndMax(data, numSamples);
+            auto blockPeak = jmax(-range.getStart(), range.getEnd());
+            auto blockTruePeak = jmax(blockPeak, getTruePeak(state, data, numSamples));
+
+            state.meanSquare += (getSumOfSquares(data, numSamples) / (float) numSamples - state.meanSquare) * rmsAlpha;
+
+            state.reading.peak = jmax(blockPeak, state.reading.peak * peakFall);
+            state.reading.truePeak = jmax(blockTruePeak, state.reading.truePeak * peakFall);
+            state.reading.rms = std::sqrt(state.meanSquare);
+        }
+    }
+
+    const Reading& getReading(int channel) const { return channels[jlimit(0, (int) maxChannels - 1, channel)].reading; }
+
+private:
+    static constexpr double peakFallDbPerSecond = 20.0;
+    static constexpr double rmsSeconds = 0.3;
+
+    struct ChannelState
+    {
+        Reading reading;
+        float meanSquare = 0.0f;
+
+        // Last input samples, written twice so a window never wraps
+        float history[2 * tapsPerPhase];
+        int historyPosition = 0;
+    };
+
+    /*
+    * Polyphase interpolation filter, with the coefficients
+    * of tap k of every phase side by side.
+    */
+    struct TruePeakFilter
+    {
+        TruePeakFilter()
+        {
+            const auto numTaps = (int) (oversampling * tapsPerPhase);
+            const auto centre = (numTaps - 1) * 0.5;
+
+            for (auto p = 0; p < oversampling; ++p)
+            {
+                auto sum = 0.0;
+
+                for (auto k = 0; k < tapsPerPhase; ++k)
+                {
+                    auto n = p + k * oversampling;
+                    auto x = (n - centre) / oversampling;
+                    auto sinc = x == 0.0 ? 1.0 : std::sin(MathConstants<double>::pi * x) / (MathConstants<double>::pi * x);
+
+                    // Blackman window
+                    auto phase = MathConstants<double>::twoPi * n / (numTaps - 1);
+                    auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+
+                    coefficients[k][p] = (float) (sinc * window);
+                    sum += coefficients[k][p];
+                }
+
+                // Unity gain at DC on every phase
+                for (auto k = 0; k < tapsPerPhase; ++k)
+                    coefficients[k][p] = (float) (coefficients[k][p] / sum);
+            }
+        }
+
+        // Each row is one register of phases, so it loads aligned
+        alignas(16) float coefficients[tapsPerPhase][oversampling];
+    };
+
+    static const TruePeakFilter& getFilter()
+    {
+        static const TruePeakFilter filter;
+        return filter;
+    }
+
+    /*
+    * Largest magnitude of the signal between samples,
+    * carrying the filter history over to the next block.
+    */
+    static float getTruePeak(ChannelState& state, const float* data, int numSamples)
+    {
+        auto& filter = getFilter();
+
+       #if JUCE_USE_SIMD
+        using Vec = dsp::SIMDRegister<float>;
+
+        // Every phase in one register: a tap is one multiply-add
+        if (Vec::size() == (size_t) oversampling)
+        {
+            Vec taps[tapsPerPhase];
+
+            for (auto k = 0; k < tapsPerPhase; ++k)
+                taps[k] = Vec::fromRawArray(filter.coefficients[k]);
+
+            auto peaks = Vec::expand(0.0f);
+
+            for (auto i = 0; i < numSamples; ++i)
+            {
+                auto* window = pushHistory(state, data[i]);
+                auto phases = Vec::expand(0.0f);
+
+                for (auto k = 0; k < tapsPerPhase; ++k)
+                    phases += taps[k] * window[tapsPerPhase - 1 - k];
+
+                peaks = Vec::max(peaks, Vec::abs(phases));
+            }
+
+            auto peak = 0.0f;
+
+            for (size_t p = 0; p < Vec::size(); ++p)
+                peak = jmax(peak, peaks.get(p));
+
+            return peak;
+        }
+       #endif
+
+        auto peak = 0.0f;
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            auto* window = pushHistory(state, data[i]);
+            float phases[oversampling] = {};
+
+            for (auto k = 0; k < tapsPerPhase; ++k)
+            {
+                auto x = window[tapsPerPhase - 1 - k];
+
+                for (auto p = 0; p < oversampling; ++p)
+                    phases[p] += filter.coefficients[k][p] * x;
+            }
+
+            for (auto p = 0; p < oversampling; ++p)
+                peak = jmax(peak, std::abs(phases[p]));
+        }
+
+        return peak;
+    }
+
+    /*
+    * Adds a sample to the filter history and returns
+    * the window ending on it, oldest sample first.
+    */
+    static const float* pushHistory(ChannelState& state, float sample)
+    {
+        auto position = state.historyPosition;
+        state.history[position] = state.history[position + tapsPerPhase] = sample;
+        state.historyPosition = position + 1 < tapsPerPhase ? position + 1 : 0;
+
+        return state.history + position + 1;
+    }
+
+    static float getSumOfSquares(const float* data, int numSamples)
+    {
+        auto sum = 0.0f;
+        auto i = 0;
+
+       #if JUCE_USE_SIMD
+        using Vec = dsp::SIMDRegister<float>;
+
+        // Scalar until the data is aligned for the registers
+        for (; i < numSamples && !Vec::isSIMDAligned(data + i); ++i)
+            sum += data[i] * data[i];
+
+        auto numVectorised = numSamples - ((numSamples - i) % (int) Vec::size());
+        auto squares = Vec::expand(0.0f);
+
+        for (; i < numVectorised; i += (int) Vec::size())
+        {
+            auto v = Vec::fromRawArray(data + i);
+            squares += v * v;
+        }
+
+        sum += squares.sum();
+       #endif
+
+        for (; i < numSamples; ++i)
+            sum += data[i] * data[i];
+
+        return sum;
+    }
+
+    ChannelState channels[maxChannels];
+    float peakFallPerSample = 0.0f;
+    float rmsDecayPerSample = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeter)
+};
+
+/*
+* Readings of the master and of every channel meter,
+* as the processor hands them to the editor.
+*/
+struct MeterSnapshot
+{
+    enum
+    {
+        maxChannels = 32
+    };
+
+    LevelMeter::Reading master[LevelMeter::maxChannels];
+    LevelMeter::Reading channels[maxChannels][LevelMeter::maxChannels];
+    int numChannels = 0;
+};
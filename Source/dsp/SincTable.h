@@ -0,0 +1,131 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Kaiser-windowed sinc filters for VoiceRenderKernel,
+* precomputed once and shared by every voice through a
+* SharedResourcePointer.
+*
+* Playing a sample faster than its rate needs a lower cutoff to
+* avoid aliasing, so there's one filter per band of increments,
+* half an octave apart. Each band stores numPhases + 1 rows of
+* coefficients for fractional positions from 0 to 1; the kernel
+* blends the two rows around the actual position.
+* Lower cutoffs need longer filters, so the cost per frame grows
+* with the increment.
+*/
+class SincTable
+{
+public:
+    enum
+    {
+        numBands = 7,
+        numPhases = 128,
+        maxTaps = 64
+    };
+
+    SincTable()
+    {
+        for (auto band = 0; band < numBands; ++band)
+        {
+            auto maxIncrement = std::pow(2.0, band * 0.5);
+            auto numTaps = jmin((int) maxTaps, (int) std::ceil(maxIncrement) * 8);
+            auto cutoff = passband / maxIncrement;
+
+            bands[band].numTaps = numTaps;
+            bands[band].maxIncrement = maxIncrement;
+            bands[band].coefficients.allocate((size_t) ((numPhases + 1) * numTaps), true);
+
+            for (auto phase = 0; phase <= numPhases; ++phase)
+                fillRow(bands[band].coefficients + phase * numTaps, numTaps, cutoff, (double) phase / numPhases);
+        }
+    }
+
+    /*
+    * Returns the band to use for the given increment.
+    * Increments past the last band use the last one.
+    */
+    int getBand(double increment) const
+    {
+        for (auto band = 0; band < numBands; ++band)
+            if (increment <= bands[band].maxIncrement + 1.0e-9)
+                return band;
+
+        return numBands - 1;
+    }
+
+    int getNumTaps(int band) const { return bands[band].numTaps; }
+
+    /*
+    * Writes the coefficients of the given band for a fractional
+    * position in [0, 1). Tap 0 applies to source index
+    * (int) position - (numTaps / 2 - 1).
+    */
+    void getCoefficients(int band, float fraction, float* dest) const
+    {
+        auto& b = bands[band];
+        auto scaled = fraction * (float) numPhases;
+        auto phase = jmin((int) scaled, (int) numPhases - 1);
+        auto alpha = scaled - (float) phase;
+
+        auto* row0 = b.coefficients + phase * b.numTaps;
+        auto* row1 = row0 + b.numTaps;
+
+        for (auto i = 0; i < b.numTaps; ++i)
+            dest[i] = row0[i] + (row1[i] - row0[i]) * alpha;
+    }
+
+private:
+    static constexpr double passband = 0.9;
+    static constexpr double kaiserBeta = 8.0;
+
+    struct Band
+    {
+        HeapBlock<float> coefficients;
+        double maxIncrement = 1.0;
+        int numTaps = 0;
+    };
+
+    /*
+    * One row of a windowed sinc, normalised to unity gain at DC.
+    */
+    static void fillRow(float* row, int numTaps, double cutoff, double fraction)
+    {
+        auto halfLength = numTaps / 2;
+        auto sum = 0.0;
+        HeapBlock<double> values((size_t) numTaps);
+
+        for (auto i = 0; i < numTaps; ++i)
+        {
+            auto distance = (double) (i - (halfLength - 1)) - fraction;
+            auto x = cutoff * distance;
+            auto sinc = std::abs(x) < 1.0e-9 ? 1.0 : std::sin(MathConstants<double>::pi * x) / (MathConstants<double>::pi * x);
+            auto w = distance / halfLength;
+            auto window = std::abs(w) >= 1.0 ? 0.0 : besselI0(kaiserBeta * std::sqrt(1.0 - w * w)) / besselI0(kaiserBeta);
+
+            values[i] = cutoff * sinc * window;
+            sum += values[i];
+        }
+
+        for (auto i = 0; i < numTaps; ++i)
+            row[i] = (float) (values[i] / sum);
+    }
+
+    static double besselI0(double x)
+    {
+        auto sum = 1.0, term = 1.0;
+
+        for (auto k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    Band bands[numBands];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SincTable)
+};
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SincTable.h"
+
+/*
+* Resampling and mixing kernel used by DrumVoice.
+*
+* The voice works out up front how many output frames it can render
+* before running out of source data, then hands the whole span here,
+* so the inner loops carry no end-of-sample or channel checks.
+* Frames are interpolated a chunk at a time into aligned scratch
+* with SIMD registers and then mixed into the output with
+* FloatVectorOperations. A source played at its own rate skips
+* interpolation and is mixed straight from the sample data.
+*
+* Three interpolation qualities are available, from cheapest to best:
+* linear (2 taps), 4-point Hermite and windowed sinc (8 to 64 taps,
+* see SincTable).
+*/
+class VoiceRenderKernel
+{
+public:
+    enum
+    {
+        chunkSize = 256,
+
+        // Widest reach of any mode around the interpolated position
+        maxTapsBefore = SincTable::maxTaps / 2 - 1,
+        maxTapsAfter = SincTable::maxTaps / 2
+    };
+
+    enum Interpolation
+    {
+        linear = 0,
+        hermite,
+        sinc,
+        numInterpolations
+    };
+
+    /*
+    * Returns the name shown for the given interpolation.
+    */
+    static String getInterpolationName(int interpolation)
+    {
+        switch (interpolation)
+        {
+            case linear:    return "Linear";
+            case hermite:   return "Hermite";
+            case sinc:      return "Sinc";
+            default:        return {};
+        }
+    }
+
+    /*
+    * Interpolation settings for one note: the mode, plus
+    * the sinc band and the taps it reads around each position.
+    */
+    struct Interpolator
+    {
+        Interpolator() = default;
+
+        Interpolator(Interpolation interpolationMode, double increment, const SincTable& sincTable)
+            : mode(interpolationMode)
+            , table(&sincTable)
+        {
+            switch (mode)
+            {
+                case hermite:
+                    tapsBefore = 1;
+                    tapsAfter = 2;
+                    break;
+
+                case sinc:
+                    band = table->getBand(increment);
+                    tapsBefore = table->getNumTaps(band) / 2 - 1;
+                    tapsAfter = table->getNumTaps(band) / 2;
+                    break;
+
+                default:
+                    mode = linear;
+                    break;
+            }
+        }
+
+        Interpolation mode = linear;
+        const SincTable* table = nullptr;
+        int band = 0;
+        int tapsBefore = 0;
+        int tapsAfter = 1;
+    };
+
+    /*
+    * Sample data as one contiguous array per channel.
+    * Indices before the start of the sample read as silence.
+    */
+    struct PlanarSource
+    {
+        static constexpr bool isContiguous = true;
+
+        float getSample(int channel, int64 index) const noexcept { return index < 0 ? 0.0f : channels[channel][index]; }
+        const float* getPointer(int channel, int64 index) const noexcept { return channels[channel] + index; }
+
+        const float* channels[2];
+    };
+
+    /*
+    * Returns how many frames, up to maxFrames, can be rendered from
+    * position with every interpolation tap, up to index + tapsAfter,
+    * below endIndex.
+    */
+    static int getNumFramesBefore(int64 endIndex, double position, double increment, int maxFrames, int tapsAfter = 1)
+    {
+        auto limit = (double) (endIndex - tapsAfter);
+
+        if (maxFrames <= 0 || position >= limit)
+            return 0;
+
+        auto numFrames = (int) jmin((double) maxFrames, std::ceil((limit - position) / increment));
+
+        // Match the kernel's own position arithmetic exactly
+        while (numFrames > 0 && position + (numFrames - 1) * increment >= limit)
+            --numFrames;
+
+        while (numFrames < maxFrames && position + numFrames * increment < limit)
+            ++numFrames;
+
+        return numFrames;
+    }
+
+    /*
+    * Per-sample gain applied while mixing,
+    * linearly ramping towards its target.
+    */
+    using Gain = SmoothedValue<float, ValueSmoothingTypes::Linear>;
+
+    /*
+    * Adds numFrames of the source, read from position at the given
+    * increment, to the outputs, applying gainL and gainR as they move
+    * towards their targets. A null outR mixes both source channels
+    * to mono, each with its own gain.
+    * Returns the position after the last frame.
+    */
+    template <int numSourceChannels, typename SourceType>
+    static double render(const SourceType& source,
+                         float* outL,
+                         float* outR,
+                         int numFrames,
+                         double position,
+                         double increment,
+                         const Interpolator& interpolator,
+                         Gain& gainL,
+                         Gain& gainR)
+    {
+        static_assert(numSourceChannels == 1 || numSourceChannels == 2, "Only mono and stereo sources");
+
+        if (numFrames <= 0)
+            return position;
+
+        // Every mode goes through the samples themselves at integer positions
+        if (SourceType::isContiguous && increment == 1.0 && position == std::floor(position) && position >= 0.0)
+        {
+            auto start = (int64) position;
+            auto* inL = source.getPointer(0, start);
+            auto* inR = source.getPointer(numSourceChannels - 1, start);
+
+            for (auto done = 0; done < numFrames; done += chunkSize)
+                mix(inL + done,
+                    inR + done,
+                    outL + done,
+                    outR != nullptr ? outR + done : nullptr,
+                    jmin((int) chunkSize, numFrames - done),
+                    gainL, gainR);
+
+            return position + numFrames;
+        }
+
+        alignas(32) float chunkL[chunkSize];
+        alignas(32) float chunkR[chunkSize];
+
+        for (auto done = 0; done < numFrames; done += chunkSize)
+        {
+            auto num = jmin((int) chunkSize, numFrames - done);
+            auto chunkPosition = position + done * increment;
+
+            switch (interpolator.mode)
+            {
+                case hermite:
+                    interpolateHermite<numSourceChannels>(source, chunkL, chunkR, num, chunkPosition, increment);
+                    break;
+
+                case sinc:
+                    interpolateSinc<numSourceChannels>(source, chunkL, chunkR, num, chunkPosition, increment, interpolator);
+                    break;
+
+                default:
+                    interpolateLinear<numSourceChannels>(source, chunkL, chunkR, num, chunkPosition, increment);
+                    break;
+            }
+
+            mix(chunkL,
+                numSourceChannels > 1 ? chunkR : chunkL,
+                outL + done,
+                outR != nullptr ? outR + done : nullptr,
+                num, gainL, gainR);
+        }
+
+        return position + numFrames * increment;
+    }
+
+    /*
+    * Same as above with fixed gains.
+    */
+    template <int numSourceChannels, typename SourceType>
+    static double render(const SourceType& source,
+                         float* outL,
+                         float* outR,
+                         int numFrames,
+                         double position,
+                         double increment,
+                         const Interpolator& interpolator,
+                         float gainL,
+                         float gainR)
+    {
+        Gain fixedL(gainL), fixedR(gainR);
+        return render<numSourceChannels>(source, outL, outR, numFrames, position, increment, interpolator, fixedL, fixedR);
+    }
+
+private:
+   #if JUCE_USE_SIMD
+    using Vec = dsp::SIMDRegister<float>;
+   #endif
+
+    /*
+    * Linear interpolation of num frames into aligned destinations.
+    * Taps are gathered first, then blended a register at a time.
+    */
+    template <int numSourceChannels, typename SourceType>
+    static void interpolateLinear(const SourceType& source,
+                                  float* destL,
+                                  float* destR,
+                                  int num,
+                                  double position,
+                                  double increment)
+    {
+        alignas(32) float alpha[chunkSize];
+        alignas(32) float tapsL[2][chunkSize];
+        alignas(32) float tapsR[2][chunkSize];
+
+        for (auto i = 0; i < num; ++i)
+        {
+            auto pos = position + i * increment;
+            auto index = (int64) std::floor(pos);
+            alpha[i] = (float) (pos - (double) index);
+
+            for (auto t = 0; t < 2; ++t)
+            {
+                tapsL[t][i] = source.getSample(0, index + t);
+
+                if (numSourceChannels > 1)
+                    tapsR[t][i] = source.getSample(1, index + t);
+            }
+        }
+
+        auto i = 0;
+
+       #if JUCE_USE_SIMD
+        auto numVectorised = num - (num % (int) Vec::size());
+
+        for (; i < numVectorised; i += (int) Vec::size())
+        {
+            auto a = Vec::fromRawArray(alpha + i);
+            auto l0 = Vec::fromRawArray(tapsL[0] + i);
+            auto l1 = Vec::fromRawArray(tapsL[1] + i);
+            (l0 + (l1 - l0) * a).copyToRawArray(destL + i);
+
+            if (numSourceChannels > 1)
+            {
+                auto r0 = Vec::fromRawArray(tapsR[0] + i);
+                auto r1 = Vec::fromRawArray(tapsR[1] + i);
+                (r0 + (r1 - r0) * a).copyToRawArray(destR + i);
+            }
+        }
+       #endif
+
+        for (; i < num; ++i)
+        {
+            destL[i] = tapsL[0][i] + (tapsL[1][i] - tapsL[0][i]) * alpha[i];
+
+            if (numSourceChannels > 1)
+                destR[i] = tapsR[0][i] + (tapsR[1][i] - tapsR[0][i]) * alpha[i];
+        }
+    }
+
+    /*
+    * 4-point, 3rd order Hermite interpolation, reading
+    * taps index - 1 to index + 2 of every frame.
+    */
+    template <int numSourceChannels, typename SourceType>
+    static void interpolateHermite(const SourceType& source,
+                                   float* destL,
+                                   float* destR,
+                                   int num,
+                                   double position,
+                                   double increment)
+    {
+        alignas(32) float alpha[chunkSize];
+        alignas(32) float tapsL[4][chunkSize];
+        alignas(32) float tapsR[4][chunkSize];
+
+        for (auto i = 0; i < num; ++i)
+        {
+            auto pos = position + i * increment;
+            auto index = (int64) std::floor(pos);
+            alpha[i] = (float) (pos - (double) index);
+
+            for (auto t = 0; t < 4; ++t)
+            {
+                tapsL[t][i] = source.getSample(0, index + t - 1);
+
+                if (numSourceChannels > 1)
+                    tapsR[t][i] = source.getSample(1, index + t - 1);
+            }
+        }
+
+        blendHermite(tapsL, alpha, destL, num);
+
+        if (numSourceChannels > 1)
+            blendHermite(tapsR, alpha, destR, num);
+    }
+
+    static void blendHermite(const float (&taps)[4][chunkSize], const float* alpha, float* dest, int num)
+    {
+        auto i = 0;
+
+       #if JUCE_USE_SIMD
+        auto numVectorised = num - (num % (int) Vec::size());
+        auto half = Vec::expand(0.5f);
+        auto oneAndHalf = Vec::expand(1.5f);
+        auto two = Vec::expand(2.0f);
+        auto twoAndHalf = Vec::expand(2.5f);
+
+        for (; i < numVectorised; i += (int) Vec::size())
+        {
+            auto x = Vec::fromRawArray(alpha + i);
+            auto ym1 = Vec::fromRawArray(taps[0] + i);
+            auto y0 = Vec::fromRawArray(taps[1] + i);
+            auto y1 = Vec::fromRawArray(taps[2] + i);
+            auto y2 = Vec::fromRawArray(taps[3] + i);
+
+            auto c1 = half * (y1 - ym1);
+            auto c2 = ym1 - twoAndHalf * y0 + two * y1 - half * y2;
+            auto c3 = half * (y2 - ym1) + oneAndHalf * (y0 - y1);
+
+            (((c3 * x + c2) * x + c1) * x + y0).copyToRawArray(dest + i);
+        }
+       #endif
+
+        for (; i < num; ++i)
+        {
+            auto x = alpha[i];
+            auto ym1 = taps[0][i], y0 = taps[1][i], y1 = taps[2][i], y2 = taps[3][i];
+
+            auto c1 = 0.5f * (y1 - ym1);
+            auto c2 = ym1 - 2.5f * y0 + 2.0f * y1 - 0.5f * y2;
+            auto c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+
+            dest[i] = ((c3 * x + c2) * x + c1) * x + y0;
+        }
+    }
+
+    /*
+    * Windowed sinc interpolation: each frame is the dot product of
+    * the band's taps around the position with the coefficients
+    * blended for its fraction.
+    */
+    template <int numSourceChannels, typename SourceType>
+    static void interpolateSinc(const SourceType& source,
+                                float* destL,
+                                float* destR,
+                                int num,
+                                double position,
+                                double increment,
+                                const Interpolator& interpolator)
+    {
+        alignas(32) float coefficients[SincTable::maxTaps];
+        alignas(32) float taps[SincTable::maxTaps];
+
+        auto numTaps = interpolator.table->getNumTaps(interpolator.band);
+
+        for (auto i = 0; i < num; ++i)
+        {
+            auto pos = position + i * increment;
+            auto index = (int64) std::floor(pos);
+            auto first = index - interpolator.tapsBefore;
+
+            interpolator.table->getCoefficients(interpolator.band, (float) (pos - (double) index), coefficients);
+
+            gather(source, 0, first, numTaps, taps);
+            destL[i] = dot(taps, coefficients, numTaps);
+
+            if (numSourceChannels > 1)
+            {
+                gather(source, 1, first, numTaps, taps);
+                destR[i] = dot(taps, coefficients, numTaps);
+            }
+        }
+    }
+
+    template <typename SourceType>
+    static void gather(const SourceType& source, int channel, int64 first, int num, float* dest)
+    {
+        if (SourceType::isContiguous && first >= 0)
+        {
+            memcpy(dest, source.getPointer(channel, first), (size_t) num * sizeof(float));
+            return;
+        }
+
+        for (auto t = 0; t < num; ++t)
+            dest[t] = source.getSample(channel, first + t);
+    }
+
+    /*
+    * Dot product of two aligned arrays, num being a multiple of 8.
+    */
+    static float dot(const float* a, const float* b, int num)
+    {
+        auto i = 0;
+        auto result = 0.0f;
+
+       #if JUCE_USE_SIMD
+        auto numVectorised = num - (num % (int) Vec::size());
+        auto sum = Vec::expand(0.0f);
+
+        for (; i < numVectorised; i += (int) Vec::size())
+            sum += Vec::fromRawArray(a + i) * Vec::fromRawArray(b + i);
+
+        result = sum.sum();
+       #endif
+
+        for (; i < num; ++i)
+            result += a[i] * b[i];
+
+        return result;
+    }
+
+    /*
+    * Mixes one chunk, moving the gains on by num samples.
+    * While a gain ramps, its per-sample values are written
+    * to scratch and multiplied in with the source.
+    */
+    static void mix(const float* inL,
+                    const float* inR,
+                    float* outL,
+                    float* outR,
+                    int num,
+                    Gain& gainL,
+                    Gain& gainR)
+    {
+        auto scale = outR != nullptr ? 1.0f : 0.5f;
+        auto* outForR = outR != nullptr ? outR : outL;
+
+        addWithGain(outL, inL, gainL, scale, num);
+        addWithGain(outForR, inR, gainR, scale, num);
+    }
+
+    static void addWithGain(float* dest, const float* src, Gain& gain, float scale, int num)
+    {
+        if (!gain.isSmoothing())
+        {
+            FloatVectorOperations::addWithMultiply(dest, src, gain.getCurrentValue() * scale, num);
+            return;
+        }
+
+        alignas(32) float ramp[chunkSize];
+
+        for (auto i = 0; i < num; ++i)
+            ramp[i] = gain.getNextValue() * scale;
+
+        FloatVectorOperations::addWithMultiply(dest, src, ramp, num);
+    }
+};
@@ -1,28 +1,67 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SampleStreamer.h"
 
 class DrumsetXmlHandler
 {
 public:
-    DrumsetXmlHandler()
+    enum
     {
-        auto dir = file.getCurrentWorkingDirectory();
-        auto path = dir.getChildFile("../../../../../Source/utils/mixer_info.xml");
+        maxChokeGroups = 32
+    };
 
+    DrumsetXmlHandler() : DrumsetXmlHandler(getDefaultKitFile()) { }
+
+    /*
+    *   Reads a kit from the given file, laid out as mixer_info.xml
+    */
+    explicit DrumsetXmlHandler(const File& path)
+    {
         if (path.existsAsFile())
         {
-            drumsetInfo = new XmlDocument(path);
+            drumsetInfo = std::make_unique<XmlDocument>(path);
             auto mixer = drumsetInfo->getDocumentElement();
 
-            if (mixer->hasTagName("mixer"))
+            if (mixer != nullptr && mixer->hasTagName("mixer"))
             {
+                kitName = mixer->getStringAttribute("name", path.getFileNameWithoutExtension());
+                sampleFolder = mixer->hasAttribute("samples")
+                    ? path.getParentDirectory().getChildFile(mixer->getStringAttribute("samples"))
+                    : getProjectRoot().getChildFile("Resources/Samples");
+                streaming.enabled = mixer->getBoolAttribute("streaming", streaming.enabled);
+                streaming.preloadSamples = mixer->getIntAttribute("preloadSamples", streaming.preloadSamples);
+                streaming.readAheadSamples = mixer->getIntAttribute("readAheadSamples", streaming.readAheadSamples);
+                defaultVoiceStealing = mixer->getStringAttribute("voiceStealing", defaultVoiceStealing);
+                renderThreads = jmax(1, mixer->getIntAttribute("renderThreads", renderThreads));
+                performanceLog = mixer->getBoolAttribute("performanceLog", performanceLog);
+                defaultRoundRobins = jmax(1, mixer->getIntAttribute("roundRobins", defaultRoundRobins));
+                defaultRoundRobinMode = mixer->getStringAttribute("roundRobinMode", defaultRoundRobinMode);
+
                 for (auto* child = mixer->getFirstChildElement(); child != nullptr; child = child->getNextElement())
                 {
                     if (child->hasTagName("channel") && child->getAttributeValue(2) == "active")
                     {
                         auto index = atoi(child->getAttributeValue(0).getCharPointer());
                         outputs.insert(index, child->getStringAttribute("name"));
+
+                        if (child->hasAttribute("voiceStealing"))
+                            voiceStealing.set(child->getStringAttribute("name"), child->getStringAttribute("voiceStealing"));
+
+                        if (child->hasAttribute("roundRobins"))
+                            roundRobins.set(child->getStringAttribute("name"), child->getStringAttribute("roundRobins"));
+
+                        if (child->hasAttribute("roundRobinMode"))
+                            roundRobinMode.set(child->getStringAttribute("name"), child->getStringAttribute("roundRobinMode"));
+
+                        if (child->hasAttribute("chokeGroup"))
+                            chokeGroup.set(child->getStringAttribute("name"), child->getStringAttribute("chokeGroup"));
+
+                        if (child->hasAttribute("chokes"))
+                            chokes.set(child->getStringAttribute("name"), child->getStringAttribute("chokes"));
+
+                        if (child->hasAttribute("note"))
+                            notes.set(child->getStringAttribute("name"), child->getStringAttribute("note"));
                     }
                     else
                     {
@@ -42,19 +81,147 @@ public:
         }
     }
 
-    ~DrumsetXmlHandler()
+    ~DrumsetXmlHandler() { }
+
+    /*
+    *   Get active output channel names as StringArray
+    */
+    StringArray getActiveOutputs() { return outputs; }
+
+    /*
+    *   Get the kit's name attribute, else its file name
+    */
+    String getKitName() const { return kitName; }
+
+    /*
+    *   Get the folder holding the kit's samples: its samples
+    *   attribute, relative to the kit file, else Resources/Samples
+    */
+    File getSampleFolder() const { return sampleFolder; }
+
+    /*
+    *   Get the midi note the given channel plays:
+    *   its own note attribute, else defaultNote
+    */
+    int getMidiNote(const String& channelName, int defaultNote) const
     {
-        drumsetInfo = nullptr;
+        return jlimit(0, 127, notes.getValue(channelName, String(defaultNote)).getIntValue());
     }
 
     /*
-    *   Get active output channel names as StringArray
+    *   Get disk streaming settings of the <mixer> element
+    */
+    StreamingOptions getStreamingOptions() const { return streaming; }
+
+    /*
+    *   Get the voice stealing policy name of the given channel:
+    *   its own voiceStealing attribute, else the <mixer> one
     */
-    StringArray DrumsetXmlHandler::getActiveOutputs() { return outputs; }
+    String getVoiceStealing(const String& channelName) const
+    {
+        return voiceStealing.getValue(channelName, defaultVoiceStealing);
+    }
+
+    /*
+    *   Get how many round-robin samples each velocity layer
+    *   of the given channel has: its own roundRobins attribute,
+    *   else the <mixer> one
+    */
+    int getRoundRobins(const String& channelName) const
+    {
+        return jmax(1, roundRobins.getValue(channelName, String(defaultRoundRobins)).getIntValue());
+    }
+
+    /*
+    *   Get the name of the round-robin mode of the given channel:
+    *   its own roundRobinMode attribute, else the <mixer> one
+    */
+    String getRoundRobinMode(const String& channelName) const
+    {
+        return roundRobinMode.getValue(channelName, defaultRoundRobinMode);
+    }
+
+    /*
+    *   Get the choke group (1 to 32) the given channel belongs to,
+    *   or 0 if it has no chokeGroup attribute
+    */
+    int getChokeGroup(const String& channelName) const
+    {
+        auto group = chokeGroup.getValue(channelName, "0").getIntValue();
+        return group > 0 && group <= (int) maxChokeGroups ? group : 0;
+    }
+
+    /*
+    *   Get the groups a note of the given channel chokes,
+    *   listed by its chokes attribute, as a mask with
+    *   bit n - 1 set for group n
+    */
+    uint32 getChokedGroups(const String& channelName) const
+    {
+        uint32 groups = 0;
+
+        for (auto& token : StringArray::fromTokens(chokes.getValue(channelName, {}), " ,", {}))
+        {
+            auto group = token.getIntValue();
+
+            if (group > 0 && group <= (int) maxChokeGroups)
+                groups |= (1u << (group - 1));
+        }
+
+        return groups;
+    }
+
+    /*
+    *   Get how many threads render channels, audio thread included
+    */
+    int getRenderThreads() const { return renderThreads; }
+
+    /*
+    *   Get whether the cost of every block is logged to a CSV file
+    */
+    bool isPerformanceLogEnabled() const { return performanceLog; }
+
+    /*
+    *   Returns the project root directory, used to locate
+    *   mixer_info.xml and the sample folder.
+    *   Defaults to the root as seen from the plugin build folder.
+    */
+    static File getProjectRoot() { return projectRoot(); }
+
+    /*
+    *   Overrides the project root directory.
+    *   Used by tools running outside the plugin build folder.
+    */
+    static void setProjectRoot(const File& root) { projectRoot() = root; }
+
+    /*
+    *   Returns mixer_info.xml, the kit loaded when the plugin starts
+    *   and whose channels fix its parameters and outputs.
+    */
+    static File getDefaultKitFile() { return getProjectRoot().getChildFile("Source/utils/mixer_info.xml"); }
 
 private:
-    File file;
+    static File& projectRoot()
+    {
+        static File root = File::getCurrentWorkingDirectory().getChildFile("../../../../..");
+        return root;
+    }
+
     StringArray outputs;
-    XmlDocument *drumsetInfo;
+    String kitName;
+    File sampleFolder;
+    StringPairArray notes;
+    StreamingOptions streaming;
+    StringPairArray voiceStealing;
+    String defaultVoiceStealing { "oldest" };
+    StringPairArray roundRobins;
+    StringPairArray roundRobinMode;
+    StringPairArray chokeGroup;
+    StringPairArray chokes;
+    int defaultRoundRobins = 1;
+    String defaultRoundRobinMode { "cycle" };
+    int renderThreads = 1;
+    bool performanceLog = false;
+    std::unique_ptr<XmlDocument> drumsetInfo;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DrumsetXmlHandler)
 };
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Counters of what each audio block cost, recorded on the audio
+* thread into a lock-free ring and drained by a background thread.
+*
+* The audio thread only copies one record per block into the ring,
+* never waiting: if the ring is full the record is counted as lost.
+* The background thread keeps a summary of the last second for the
+* editor and, when given a file, appends every record to it as CSV.
+*/
+class PerformanceCounters : private Thread
+{
+public:
+    enum
+    {
+        maxChannels = 32,
+        ringSize = 2048,        // records, about 2.7 s of 64 sample blocks at 48 kHz
+        drainIntervalMs = 50,
+        summaryWindowMs = 1000
+    };
+
+    /*
+    * What one block cost. Times are in microseconds.
+    */
+    struct BlockRecord
+    {
+        int64 blockIndex = 0;
+        int numSamples = 0;
+        float blockMicros = 0.0f;
+        float budgetMicros = 0.0f;      // audio length of the block
+        int activeVoices = 0;
+        int droppedNotes = 0;           // note-ons with no voice to play them
+        int streamUnderruns = 0;        // voices the streamer was late for
+        int loaderQueue = 0;            // sample loader jobs queued or running
+        int releaseQueue = 0;           // retired objects not deleted yet
+        int numChannels = 0;
+        float channelMicros[maxChannels] = {};
+    };
+
+    /*
+    * Figures over the last second, for display.
+    */
+    struct Summary
+    {
+        float averageLoad = 0.0f;       // block time over budget, 1 being the deadline
+        float peakLoad = 0.0f;
+        int activeVoices = 0;
+        int loaderQueue = 0;
+        int releaseQueue = 0;
+        int64 numBlocks = 0;            // totals since start
+        int64 numOverruns = 0;
+        int64 droppedNotes = 0;
+        int64 streamUnderruns = 0;
+        int64 numLost = 0;
+        int numChannels = 0;
+        float channelMicros[maxChannels] = {};     // average per block
+    };
+
+    PerformanceCounters() : Thread("DrumSampler Performance")
+    {
+        records.calloc((size_t) ringSize);
+    }
+
+    ~PerformanceCounters()
+    {
+        stop();
+        closeLog();
+    }
+
+    /*
+    * Starts draining the ring in background.
+    */
+    void start()
+    {
+        if (!isThreadRunning())
+            startThread(2);
+    }
+
+    /*
+    * Stops the background thread, writing what's left first.
+    */
+    void stop()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+        drain();
+    }
+
+    /*
+    * Appends every record from now on to the given CSV file,
+    * or stops logging if the file is File(). Not for the audio thread.
+    */
+    void setLogFile(const File& file)
+    {
+        const ScopedLock sl(logLock);
+        logFile = file;
+        logFileChanged = true;
+    }
+
+    /*
+    * Copies a record into the ring. Called from the audio thread only.
+    */
+    void push(const BlockRecord& record)
+    {
+        const auto scope = fifo.write(1);
+
+        if (scope.blockSize1 > 0)
+            records[scope.startIndex1] = record;
+        else
+            numLost.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+    * Returns the figures of the last second. Not for the audio thread.
+    */
+    Summary getSummary() const
+    {
+        const ScopedLock sl(summaryLock);
+        return summary;
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(drainIntervalMs);
+            drain();
+        }
+    }
+
+    /*
+    * Takes every record out of the ring into the summary and the log.
+    * Called from the background thread, or once it has stopped.
+    */
+    void drain()
+    {
+        updateLogFile();
+
+        for (;;)
+        {
+            const auto scope = fifo.read(1);
+
+            if (scope.blockSize1 == 0)
+                break;
+
+            add(records[scope.startIndex1]);
+        }
+
+        if (log != nullptr)
+            log->flush();
+
+        const ScopedLock sl(summaryLock);
+        summary.numLost = numLost.load(std::memory_order_relaxed);
+    }
+
+    void add(const BlockRecord& record)
+    {
+        auto load = record.budgetMicros > 0.0f ? record.blockMicros / record.budgetMicros : 0.0f;
+        auto now = Time::getMillisecondCounter();
+
+        // Starts a new window once the current one is over
+        if (now - windowStart >= (uint32) summaryWindowMs)
+        {
+            windowStart = now;
+            windowBlocks = 0;
+            windowLoad = 0.0f;
+            windowPeak = 0.0f;
+            std::fill(std::begin(windowChannelMicros), std::end(windowChannelMicros), 0.0f);
+        }
+
+        ++windowBlocks;
+        windowLoad += load;
+        windowPeak = jmax(windowPeak, load);
+
+        auto numChannels = jlimit(0, (int) maxChannels, record.numChannels);
+
+        for (auto i = 0; i < numChannels; ++i)
+            windowChannelMicros[i] += record.channelMicros[i];
+
+        {
+            const ScopedLock sl(summaryLock);
+            summary.averageLoad = windowLoad / (float) windowBlocks;
+            summary.peakLoad = windowPeak;
+            summary.activeVoices = record.activeVoices;
+            summary.loaderQueue = record.loaderQueue;
+            summary.releaseQueue = record.releaseQueue;
+            summary.numBlocks++;
+            summary.numOverruns += load > 1.0f ? 1 : 0;
+            summary.droppedNotes += record.droppedNotes;
+            summary.streamUnderruns += record.streamUnderruns;
+            summary.numChannels = numChannels;
+
+            for (auto i = 0; i < numChannels; ++i)
+                summary.channelMicros[i] = windowChannelMicros[i] / (float) windowBlocks;
+        }
+
+        if (log != nullptr)
+            writeRecord(record);
+    }
+
+    void writeRecord(const BlockRecord& record)
+    {
+        auto numChannels = jlimit(0, (int) maxChannels, record.numChannels);
+
+        // Header of a new file, with the channels the first record has
+        if (headerPending)
+        {
+            String header("block,samples,block_us,budget_us,voices,dropped_notes,stream_underruns,loader_queue,release_queue");
+
+            for (auto i = 0; i < numChannels; ++i)
+                header << ",channel" << (i + 1) << "_us";
+
+            log->writeText(header + "\n", false, false, nullptr);
+            headerPending = false;
+        }
+
+        String line;
+        line << record.blockIndex << "," << record.numSamples << ","
+             << record.blockMicros << "," << record.budgetMicros << ","
+             << record.activeVoices << "," << record.droppedNotes << ","
+             << record.streamUnderruns << "," << record.loaderQueue << ","
+             << record.releaseQueue;
+
+        for (auto i = 0; i < numChannels; ++i)
+            line << "," << record.channelMicros[i];
+
+        log->writeText(line + "\n", false, false, nullptr);
+    }
+
+    /*
+    * Opens the file given to setLogFile, if it changed.
+    * Records are appended to an existing file.
+    */
+    void updateLogFile()
+    {
+        File file;
+
+        {
+            const ScopedLock sl(logLock);
+
+            if (!logFileChanged)
+                return;
+
+            file = logFile;
+            logFileChanged = false;
+        }
+
+        closeLog();
+
+        if (file == File())
+            return;
+
+        file.getParentDirectory().createDirectory();
+        headerPending = !file.existsAsFile() || file.getSize() == 0;
+        log = file.createOutputStream();
+    }
+
+    void closeLog()
+    {
+        if (log != nullptr)
+            log->flush();
+
+        log.reset();
+    }
+
+    AbstractFifo fifo { ringSize };
+    HeapBlock<BlockRecord> records;
+    std::atomic<int64> numLost { 0 };
+
+    // Background thread only
+    std::unique_ptr<FileOutputStream> log;
+    bool headerPending = false;
+    uint32 windowStart = 0;
+    int windowBlocks = 0;
+    float windowLoad = 0.0f;
+    float windowPeak = 0.0f;
+    float windowChannelMicros[maxChannels] = {};
+
+    CriticalSection summaryLock;
+    Summary summary;
+
+    CriticalSection logLock;
+    File logFile;
+    bool logFileChanged = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceCounters)
+};
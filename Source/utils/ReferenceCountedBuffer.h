@@ -1,8 +1,9 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "ReleaseQueue.h"
 
-class ReferenceCountedBuffer : public juce::ReferenceCountedObject
+class ReferenceCountedBuffer : public ReleaseQueue::Retirable
 {
 public:
     typedef juce::ReferenceCountedObjectPtr<ReferenceCountedBuffer> Ptr;
@@ -13,14 +14,26 @@ public:
         : name (nameToUse),
         buffer (numChannels, numSamples)
     {
-        DBG (juce::String ("Buffer named '") + name + "' constructed. numChannels = " + juce::String (numChannels) + ", numSamples = " + juce::String (numSamples));
     }
 
-    ~ReferenceCountedBuffer()
+    /*
+    * Creates a buffer referring to memory-mapped sample data.
+    * The buffer keeps the mapping alive and must never be written.
+    */
+    ReferenceCountedBuffer (const juce::String& nameToUse,
+                            std::unique_ptr<juce::MemoryMappedFile> mappedFileToUse,
+                            float* const* channels,
+                            int numChannels,
+                            int numSamples)
+        : name (nameToUse),
+        mappedFile (std::move (mappedFileToUse)),
+        buffer (channels, numChannels, numSamples)
     {
-        DBG (juce::String ("Buffer named '") + name + "' destroyed");
     }
 
+    // No logging: deleted on whichever thread drops the last reference
+    ~ReferenceCountedBuffer() { }
+
     juce::AudioSampleBuffer* getAudioSampleBuffer()
     {
         return &buffer;
@@ -30,6 +43,7 @@ public:
 
 private:
     juce::String name;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
     juce::AudioSampleBuffer buffer;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReferenceCountedBuffer)
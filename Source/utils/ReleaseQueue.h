@@ -0,0 +1,142 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SampleStreamer.h"
+
+/*
+* Lets the audio thread give up references to sample buffers
+* and other reference counted objects without ever freeing them.
+*
+* retire() drops the reference without deleting: if it wasn't
+* the last one there's nothing more to do, otherwise the object
+* is pushed on a lock-free list and a background thread deletes
+* it later. The list is chained through the objects themselves,
+* so it never runs out of room and pushing never allocates.
+*
+* A retired object may be the source a stream played: the
+* background thread lets the streamer see the voice's stop()
+* before deleting anything, so it never reads a freed source.
+*/
+class ReleaseQueue : private Thread
+{
+public:
+    enum
+    {
+        drainIntervalMs = 100
+    };
+
+    /*
+    * Base of the objects a queue can take, carrying
+    * the link the queue chains them with.
+    */
+    class Retirable : public ReferenceCountedObject
+    {
+    private:
+        friend class ReleaseQueue;
+        Retirable* nextRetired = nullptr;
+    };
+
+    explicit ReleaseQueue(SampleStreamer& streamerToSync)
+        : Thread("DrumSampler Release")
+        , streamer(streamerToSync)
+    { }
+
+    ~ReleaseQueue()
+    {
+        stop();
+    }
+
+    /*
+    * Starts releasing retired objects in background.
+    */
+    void start()
+    {
+        if (!isThreadRunning())
+            startThread(1);
+    }
+
+    /*
+    * Stops the background thread, releasing what's left first.
+    */
+    void stop()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+        drain();
+    }
+
+    /*
+    * Takes over the reference held by ptr and sets it to nullptr.
+    * Safe to call from the audio thread and render workers.
+    */
+    template <typename ObjectType>
+    void retire(ReferenceCountedObjectPtr<ObjectType>& ptr)
+    {
+        Retirable* object = ptr.get();
+
+        if (object == nullptr)
+            return;
+
+        // Our own reference keeps it alive while ptr lets go of its one
+        object->incReferenceCount();
+        ptr = nullptr;
+
+        // Somebody else still holds it: they'll free it, not us
+        if (!object->decReferenceCountWithoutDeleting())
+            return;
+
+        numPending.fetch_add(1, std::memory_order_relaxed);
+        auto* first = retired.load(std::memory_order_relaxed);
+
+        do
+        {
+            object->nextRetired = first;
+        }
+        while (!retired.compare_exchange_weak(first, object, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /*
+    * Returns the number of objects waiting to be deleted.
+    */
+    int getNumPending() const { return numPending.load(std::memory_order_relaxed); }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(drainIntervalMs);
+            drain();
+        }
+    }
+
+    /*
+    * Deletes every retired object. Background thread only, or once stopped.
+    */
+    void drain()
+    {
+        auto* object = retired.exchange(nullptr, std::memory_order_acquire);
+
+        if (object == nullptr)
+            return;
+
+        // Voices stop their stream before retiring what it read:
+        // once the streamer is between passes, its next one sees it
+        streamer.waitForCurrentPass();
+
+        while (object != nullptr)
+        {
+            auto* next = object->nextRetired;
+            delete object;
+            numPending.fetch_sub(1, std::memory_order_relaxed);
+            object = next;
+        }
+    }
+
+    SampleStreamer& streamer;
+    std::atomic<Retirable*> retired { nullptr };
+    std::atomic<int> numPending { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReleaseQueue)
+};
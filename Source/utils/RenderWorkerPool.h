@@ -0,0 +1,236 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#endif
+
+/*
+* Runs independent render tasks on a few pinned worker threads
+* and the audio thread itself, which takes tasks like any worker
+* and returns once all of them are done.
+*
+* The audio thread never blocks on or signals a worker: tasks are
+* published through one atomic word holding a generation count and
+* the next task index, which workers poll. While the host is playing
+* they spin on it, when it stops they back off to yielding, then
+* to short sleeps. Work the workers haven't picked up yet is done
+* by the audio thread, so a late worker only costs parallelism.
+*
+* With no workers every task runs in order on the calling thread.
+*/
+class RenderWorkerPool
+{
+public:
+    enum
+    {
+        maxWorkers = 15,
+        spinMs = 50,        // idle time spent spinning before yielding
+        yieldMs = 500       // idle time spent yielding before sleeping
+    };
+
+    /*
+    * Work split in numbered tasks that can run concurrently.
+    */
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void runTask(int index) = 0;
+    };
+
+    /*
+    * Called by a worker with true before it takes tasks
+    * and with false after, on the worker's thread.
+    */
+    typedef void (*TaskHook)(bool isTakingTasks);
+
+    RenderWorkerPool() { }
+
+    ~RenderWorkerPool()
+    {
+        setNumWorkers(0);
+    }
+
+    /*
+    * Starts the given number of worker threads, besides the audio thread.
+    * Must not be called while run() is.
+    */
+    void setNumWorkers(int numWorkersToUse)
+    {
+        numWorkersToUse = jlimit(0, (int) maxWorkers, numWorkersToUse);
+
+        if (numWorkersToUse == workers.size())
+            return;
+
+        for (auto* w : workers)
+            w->signalThreadShouldExit();
+
+        workers.clear();
+
+        auto numCpus = SystemStats::getNumCpus();
+
+        for (auto i = 0; i < numWorkersToUse; ++i)
+        {
+            auto* worker = workers.add(new Worker(*this, i));
+
+            // Leave the first core to the host's audio thread
+            if (numCpus > 1)
+                worker->setAffinityMask((uint32) 1 << ((i + 1) % jmin(numCpus, 32)));
+
+            worker->startThread(10);
+        }
+    }
+
+    int getNumWorkers() const { return workers.size(); }
+
+    /*
+    * Sets the hook workers of every pool call around the tasks
+    * they take, or removes it if nullptr. Lets tools check the
+    * workers as they check the audio thread; none by default.
+    */
+    static void setTaskHook(TaskHook newHook) { getTaskHook().store(newHook, std::memory_order_release); }
+
+    /*
+    * Runs job.runTask(i) for every i in [0, numTasks)
+    * and returns when all of them have run.
+    * Called from the audio thread only.
+    */
+    void run(Job& job, int numTasks)
+    {
+        if (workers.isEmpty() || numTasks < 2)
+        {
+            for (auto i = 0; i < numTasks; ++i)
+                job.runTask(i);
+
+            return;
+        }
+
+        currentJob.store(&job, std::memory_order_relaxed);
+        currentNumTasks.store(numTasks, std::memory_order_relaxed);
+        numDone.store(0, std::memory_order_relaxed);
+
+        auto generation = ++lastGeneration;
+        state.store((uint64) generation << 32, std::memory_order_release);
+
+        help(generation);
+
+        while (numDone.load(std::memory_order_acquire) < numTasks)
+            pause();
+
+        // Late workers must not take tasks of this job any more
+        state.store(((uint64) generation << 32) | closed, std::memory_order_release);
+    }
+
+private:
+    enum : uint32
+    {
+        closed = 0xffffffff
+    };
+
+    class Worker : public Thread
+    {
+    public:
+        Worker(RenderWorkerPool& ownerPool, int index)
+            : Thread("DrumSampler Render " + String(index + 1))
+            , owner(ownerPool)
+        {
+        }
+
+        ~Worker()
+        {
+            stopThread(1000);
+        }
+
+        void run() override
+        {
+            ScopedNoDenormals noDenormals;
+            auto seenGeneration = (uint32) (owner.state.load(std::memory_order_acquire) >> 32);
+            auto idleSince = Time::getMillisecondCounter();
+
+            while (!threadShouldExit())
+            {
+                auto generation = (uint32) (owner.state.load(std::memory_order_acquire) >> 32);
+
+                if (generation != seenGeneration)
+                {
+                    seenGeneration = generation;
+                    auto hook = getTaskHook().load(std::memory_order_acquire);
+
+                    if (hook != nullptr)
+                        hook(true);
+
+                    owner.help(generation);
+
+                    if (hook != nullptr)
+                        hook(false);
+
+                    idleSince = Time::getMillisecondCounter();
+                    continue;
+                }
+
+                auto idleMs = Time::getMillisecondCounter() - idleSince;
+
+                if (idleMs < (uint32) spinMs)
+                    pause();
+                else if (idleMs < (uint32) yieldMs)
+                    Thread::yield();
+                else
+                    Thread::sleep(1);
+            }
+        }
+
+    private:
+        RenderWorkerPool& owner;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Worker)
+    };
+
+    /*
+    * Takes tasks of the given generation until there's none left.
+    * A task index is claimed together with the generation, so a
+    * worker waking up late can't run a task of a newer job.
+    */
+    void help(uint32 generation)
+    {
+        auto* job = currentJob.load(std::memory_order_relaxed);
+        auto numTasks = (uint32) currentNumTasks.load(std::memory_order_relaxed);
+        auto current = state.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            if ((uint32) (current >> 32) != generation || (uint32) current >= numTasks)
+                return;
+
+            if (state.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel))
+            {
+                job->runTask((int) (uint32) current);
+                numDone.fetch_add(1, std::memory_order_release);
+                current = state.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    static std::atomic<TaskHook>& getTaskHook()
+    {
+        static std::atomic<TaskHook> hook { nullptr };
+        return hook;
+    }
+
+    static void pause() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #endif
+    }
+
+    // Generation in the high half, next task index in the low half
+    std::atomic<uint64> state { closed };
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<int> currentNumTasks { 0 };
+    std::atomic<int> numDone { 0 };
+    uint32 lastGeneration = 0;
+    OwnedArray<Worker> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderWorkerPool)
+};
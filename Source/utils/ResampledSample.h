@@ -0,0 +1,146 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReferenceCountedBuffer.h"
+#include "SampleStreamer.h"
+#include "SampleCache.h"
+#include "../dsp/VoiceRenderKernel.h"
+
+/*
+* Copy of a sample converted to the host sample rate, so voices
+* playing it unpitched just copy and mix instead of resampling.
+*
+* Built on a loader worker with the sinc interpolator and stored
+* in the sample cache under the host rate, so the next session at
+* that rate only maps it. When streaming is enabled the copy is
+* streamed like the original: the buffer holds the head and the
+* rest is read from the mapped cache by the streamer.
+*/
+class ResampledSample
+    : public ReleaseQueue::Retirable
+    , public StreamSource
+{
+public:
+    typedef ReferenceCountedObjectPtr<ResampledSample> Ptr;
+
+    /*
+    * Returns a copy of the given sample data at targetRate,
+    * mapped from the cache when there's a valid one.
+    * Returns nullptr if the data can't be converted.
+    */
+    static Ptr create(const File& source,
+                      const float* const* channels,
+                      int numChannels,
+                      int numSamples,
+                      double sourceRate,
+                      double targetRate,
+                      const StreamingOptions& streaming)
+    {
+        if (numChannels <= 0 || numSamples <= 0 || sourceRate <= 0.0 || targetRate <= 0.0)
+            return nullptr;
+
+        auto cached = SampleCache::open(source, targetRate);
+
+        if (cached == nullptr)
+        {
+            auto converted = resample(channels, jmin(numChannels, 2), numSamples, sourceRate / targetRate);
+
+            if (SampleCache::write(source, converted, targetRate, targetRate))
+                cached = SampleCache::open(source, targetRate);
+
+            // Cache folder not writable: keep the copy in memory
+            if (cached == nullptr)
+                return new ResampledSample(source.getFileName(), std::move(converted), targetRate);
+        }
+
+        return new ResampledSample(source.getFileName(), std::move(cached), targetRate, streaming);
+    }
+
+    //==============================================================================
+    ReferenceCountedBuffer::Ptr getBuffer() const { return buffer; }
+
+    double getSampleRate() const { return sampleRate; }
+
+    int getLength() const { return length; }
+
+    bool isStreamed() const { return streamed; }
+
+    int64 getResidentBytes() const
+    {
+        auto* data = buffer->getAudioSampleBuffer();
+        return (int64) data->getNumChannels() * data->getNumSamples() * (int64) sizeof(float);
+    }
+
+    void readStreamSamples(AudioBuffer<float>& dest, int destStart, int64 sourceStart, int numSamples) override
+    {
+        for (auto ch = 0; ch < dest.getNumChannels(); ++ch)
+            dest.copyFrom(ch, destStart, mappedChannels[jmin(ch, numMappedChannels - 1)] + sourceStart, numSamples);
+    }
+
+    int64 getStreamLength() const override { return length; }
+
+private:
+    ResampledSample(const String& name, AudioBuffer<float>&& data, double rate)
+        : sampleRate(rate)
+        , length(data.getNumSamples())
+    {
+        buffer = new ReferenceCountedBuffer(name, data.getNumChannels(), length);
+        buffer->getAudioSampleBuffer()->makeCopyOf(data);
+    }
+
+    ResampledSample(const String& name, std::unique_ptr<SampleCache::MappedSample> cached, double rate, const StreamingOptions& streaming)
+        : sampleRate(rate)
+        , length((int) jmin(cached->numSamples, (int64) std::numeric_limits<int>::max()))
+    {
+        numMappedChannels = jmin(cached->numChannels, 2);
+        streamed = streaming.enabled && length > streaming.preloadSamples;
+        auto numResident = streamed ? streaming.preloadSamples : length;
+
+        for (auto ch = 0; ch < numMappedChannels; ++ch)
+        {
+            mappedChannels[ch] = cached->channels[ch];
+            SampleCache::prefault(mappedChannels[ch], numResident);
+        }
+
+        buffer = new ReferenceCountedBuffer(name,
+                                            std::move(cached->file),
+                                            cached->channels,
+                                            numMappedChannels,
+                                            numResident);
+    }
+
+    /*
+    * Converts the data reading it at the given increment.
+    */
+    static AudioBuffer<float> resample(const float* const* channels, int numChannels, int numSamples, double increment)
+    {
+        auto numFrames = (int) std::ceil(numSamples / increment);
+        AudioBuffer<float> result(numChannels, numFrames);
+        result.clear();
+
+        SharedResourcePointer<SincTable> sincTable;
+        VoiceRenderKernel::Interpolator interpolator(VoiceRenderKernel::sinc, increment, *sincTable);
+        VoiceRenderKernel::PlanarSource source { { channels[0], channels[numChannels - 1] } };
+
+        // The last frames would read past the end: leave them silent
+        auto numToRender = VoiceRenderKernel::getNumFramesBefore(numSamples, 0.0, increment, numFrames, interpolator.tapsAfter);
+
+        if (numChannels > 1)
+            VoiceRenderKernel::render<2>(source, result.getWritePointer(0), result.getWritePointer(1),
+                                         numToRender, 0.0, increment, interpolator, 1.0f, 1.0f);
+        else
+            VoiceRenderKernel::render<1>(source, result.getWritePointer(0), nullptr,
+                                         numToRender, 0.0, increment, interpolator, 1.0f, 1.0f);
+
+        return result;
+    }
+
+    ReferenceCountedBuffer::Ptr buffer;
+    const float* mappedChannels[2] = {};
+    int numMappedChannels = 0;
+    double sampleRate = 0.0;
+    int length = 0;
+    bool streamed = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ResampledSample)
+};
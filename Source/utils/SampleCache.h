@@ -0,0 +1,293 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* On-disk cache of decoded samples, memory-mapped at load time.
+*
+* Every source file gets a cache file holding its samples already
+* decoded to 32 bit floats, so loading a kit costs a mmap instead
+* of decoding and converting each file. Mapped read-only, the same
+* pages in the OS page cache are shared by every plugin instance.
+*
+* File layout (little endian):
+*   header, headerSize bytes:
+*     char[4] magic "DSMC"
+*     int32   format version
+*     double  sample rate of the stored data
+*     int32   number of channels
+*     int32   plane stride, in samples
+*     int64   number of samples
+*     int64   source file size in bytes
+*     int64   source file modification time, ms since epoch
+*     zero padding up to headerSize
+*   data: one plane per channel, numSamples floats each.
+*
+* Data is planar rather than interleaved: AudioBuffer and the voices
+* read one channel at a time, so each plane can be handed to an
+* AudioBuffer as is. Planes start on 64 byte boundaries (stride is
+* a multiple of 16 samples) to keep vector loads aligned.
+*
+* A cache file is stale when the source size or modification time
+* no longer match, and is then rebuilt from the source.
+*/
+class SampleCache
+{
+public:
+    enum
+    {
+        headerSize = 64,
+        formatVersion = 1,
+        planeAlignment = 16,
+        maxChannels = 8,
+        chunkSize = 65536       // samples per channel converted at once
+    };
+
+    /*
+    * A cache file mapped in memory.
+    */
+    struct MappedSample
+    {
+        std::unique_ptr<MemoryMappedFile> file;
+        float* channels[maxChannels] = {};
+        double sampleRate = 0.0;
+        int numChannels = 0;
+        int64 numSamples = 0;
+    };
+
+    /*
+    * Returns the folder holding cache files.
+    */
+    static File getCacheDirectory()
+    {
+        return File::getSpecialLocation(File::userApplicationDataDirectory)
+            .getChildFile("DrumSampler")
+            .getChildFile("SampleCache");
+    }
+
+    /*
+    * Returns the cache file for the given source.
+    * A sample rate > 0 names a copy resampled to that rate.
+    */
+    static File getCacheFile(const File& source, double sampleRate = 0.0)
+    {
+        String name;
+        name << source.getFileNameWithoutExtension() << "_"
+             << String::toHexString(source.getFullPathName().hashCode64());
+
+        if (sampleRate > 0.0)
+            name << "_" << roundToInt(sampleRate);
+
+        return getCacheDirectory().getChildFile(name + ".dsmc");
+    }
+
+    /*
+    * Maps the cache of the given source.
+    * Returns nullptr if there's no cache or it's stale.
+    */
+    static std::unique_ptr<MappedSample> open(const File& source, double sampleRate = 0.0)
+    {
+        auto cacheFile = getCacheFile(source, sampleRate);
+
+        if (!cacheFile.existsAsFile() || !source.existsAsFile())
+            return nullptr;
+
+        auto mapped = std::make_unique<MemoryMappedFile>(cacheFile, MemoryMappedFile::readOnly);
+        auto* data = static_cast<const char*> (mapped->getData());
+        auto size = (int64) mapped->getSize();
+
+        if (data == nullptr || size < headerSize || memcmp(data, "DSMC", 4) != 0)
+            return nullptr;
+
+        auto version = ByteOrder::littleEndianInt(data + 4);
+        auto storedRate = readDouble(data + 8);
+        auto numChannels = (int) ByteOrder::littleEndianInt(data + 16);
+        auto stride = (int64) ByteOrder::littleEndianInt(data + 20);
+        auto numSamples = (int64) ByteOrder::littleEndianInt64(data + 24);
+        auto sourceSize = (int64) ByteOrder::littleEndianInt64(data + 32);
+        auto sourceTime = (int64) ByteOrder::littleEndianInt64(data + 40);
+
+        if (version != formatVersion
+            || numChannels <= 0 || numChannels > maxChannels
+            || numSamples <= 0 || stride < numSamples
+            || size < headerSize + numChannels * stride * (int64) sizeof(float))
+            return nullptr;
+
+        // Source has been edited since the cache was written
+        if (sourceSize != source.getSize()
+            || sourceTime != source.getLastModificationTime().toMilliseconds())
+            return nullptr;
+
+        auto result = std::make_unique<MappedSample>();
+        auto* planes = reinterpret_cast<float*> (static_cast<char*> (mapped->getData()) + headerSize);
+
+        for (auto ch = 0; ch < numChannels; ++ch)
+            result->channels[ch] = planes + ch * stride;
+
+        result->sampleRate = storedRate;
+        result->numChannels = numChannels;
+        result->numSamples = numSamples;
+        result->file = std::move(mapped);
+
+        return result;
+    }
+
+    /*
+    * Writes the cache file of the given source.
+    * Written to a temporary file first, so instances
+    * rebuilding the same cache never see a partial file.
+    */
+    static bool write(const File& source, const AudioBuffer<float>& data, double sampleRate, double cacheRate = 0.0)
+    {
+        return write(source, data.getNumChannels(), data.getNumSamples(), sampleRate, cacheRate,
+                     [&data] (int64 start, int, const float** channels)
+                     {
+                         for (auto ch = 0; ch < jmin(data.getNumChannels(), (int) maxChannels); ++ch)
+                             channels[ch] = data.getReadPointer(ch, (int) start);
+
+                         return true;
+                     });
+    }
+
+    /*
+    * Decodes the source and writes its cache file,
+    * a chunk at a time whatever the length of the file.
+    */
+    static bool rebuild(const File& source, AudioFormatManager& formatManager)
+    {
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(source));
+
+        if (reader == nullptr || reader->sampleRate <= 0 || reader->lengthInSamples <= 0
+            || reader->lengthInSamples > std::numeric_limits<int>::max())
+            return false;
+
+        auto numChannels = jmin((int) reader->numChannels, (int) maxChannels);
+        AudioBuffer<float> chunk(numChannels, chunkSize);
+
+        return write(source, numChannels, (int) reader->lengthInSamples, reader->sampleRate, 0.0,
+                     [&reader, &chunk] (int64 start, int numSamples, const float** channels)
+                     {
+                         if (!reader->read(&chunk, 0, numSamples, start, true, true))
+                             return false;
+
+                         for (auto ch = 0; ch < chunk.getNumChannels(); ++ch)
+                             channels[ch] = chunk.getReadPointer(ch);
+
+                         return true;
+                     });
+    }
+
+    /*
+    * Touches one value per page, so the first voices
+    * don't take page faults on the audio thread.
+    */
+    static void prefault(const float* data, int numSamples)
+    {
+        const int samplesPerPage = 4096 / (int) sizeof(float);
+        volatile float sink = 0.0f;
+
+        for (auto i = 0; i < numSamples; i += samplesPerPage)
+            sink = sink + data[i];
+    }
+
+private:
+    /*
+    * Gives the data of the chunk of numSamples from start,
+    * setting a pointer per channel. Returns false on error.
+    */
+    typedef std::function<bool(int64 start, int numSamples, const float** channels)> ChunkSource;
+
+    /*
+    * Writes a cache file taking the data from nextChunk in
+    * chunks of at most chunkSize samples, each channel
+    * going to its own plane.
+    */
+    static bool write(const File& source, int numChannels, int numSamples,
+                      double sampleRate, double cacheRate, const ChunkSource& nextChunk)
+    {
+        auto cacheFile = getCacheFile(source, cacheRate);
+
+        if (!cacheFile.getParentDirectory().createDirectory())
+            return false;
+
+        numChannels = jmin(numChannels, (int) maxChannels);
+        auto stride = (numSamples + planeAlignment - 1) / planeAlignment * planeAlignment;
+
+        TemporaryFile temp(cacheFile);
+
+        {
+            FileOutputStream out(temp.getFile());
+
+            if (!out.openedOk())
+                return false;
+
+            char header[headerSize] = {};
+            memcpy(header, "DSMC", 4);
+            writeInt(header + 4, formatVersion);
+            memcpy(header + 8, &sampleRate, sizeof(double));
+            writeInt(header + 16, numChannels);
+            writeInt(header + 20, stride);
+            writeInt64(header + 24, numSamples);
+            writeInt64(header + 32, source.getSize());
+            writeInt64(header + 40, source.getLastModificationTime().toMilliseconds());
+
+            out.write(header, headerSize);
+
+            // Chunks hold every channel: each goes to its plane
+            auto planeStart = [stride] (int ch, int64 sample)
+            {
+                return (int64) headerSize + ((int64) ch * stride + sample) * (int64) sizeof(float);
+            };
+
+            const float* channels[maxChannels] = {};
+
+            for (int64 start = 0; start < numSamples; start += chunkSize)
+            {
+                auto num = (int) jmin((int64) chunkSize, numSamples - start);
+
+                if (!nextChunk(start, num, channels))
+                    return false;
+
+                for (auto ch = 0; ch < numChannels; ++ch)
+                {
+                    out.setPosition(planeStart(ch, start));
+                    out.write(channels[ch], (size_t) num * sizeof(float));
+                }
+            }
+
+            HeapBlock<float> padding(stride - numSamples + 1, true);
+
+            for (auto ch = 0; ch < numChannels; ++ch)
+            {
+                out.setPosition(planeStart(ch, numSamples));
+                out.write(padding, (size_t) (stride - numSamples) * sizeof(float));
+            }
+
+            out.flush();
+
+            if (out.getStatus().failed())
+                return false;
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    static double readDouble(const char* data)
+    {
+        double value;
+        memcpy(&value, data, sizeof(double));
+        return value;
+    }
+
+    static void writeInt(char* dest, int value)
+    {
+        auto le = ByteOrder::swapIfBigEndian((uint32) value);
+        memcpy(dest, &le, sizeof(le));
+    }
+
+    static void writeInt64(char* dest, int64 value)
+    {
+        auto le = ByteOrder::swapIfBigEndian((uint64) value);
+        memcpy(dest, &le, sizeof(le));
+    }
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Loads samples in background on a bounded pool of worker threads,
+* shared by every sound of the plugin.
+* Jobs are queued in groups: each group gets a callback when
+* its last job has run, and the loader measures the time taken
+* from the first queued job until the queue is empty again.
+*/
+class SampleLoader
+{
+public:
+    enum
+    {
+        maxWorkers = 8
+    };
+
+    SampleLoader() : pool(jlimit(1, (int) maxWorkers, SystemStats::getNumCpus())) { }
+
+    ~SampleLoader()
+    {
+        cancelAllJobs();
+    }
+
+    /*
+    * Queues the given jobs. onGroupComplete is called
+    * from a worker thread once all of them have run.
+    */
+    void addJobs(const Array<std::function<void()>>& jobs, std::function<void()> onGroupComplete)
+    {
+        if (jobs.isEmpty())
+        {
+            if (onGroupComplete != nullptr)
+                onGroupComplete();
+
+            return;
+        }
+
+        auto remaining = std::make_shared<std::atomic<int>>(jobs.size());
+
+        if (pending.fetch_add(jobs.size()) == 0)
+            loadStartTicks = Time::getHighResolutionTicks();
+
+        for (auto& job : jobs)
+        {
+            auto pendingJob = std::make_shared<PendingJob>(*this);
+
+            pool.addJob([job, remaining, onGroupComplete, pendingJob]
+            {
+                job();
+
+                if (--(*remaining) == 0 && onGroupComplete != nullptr)
+                    onGroupComplete();
+
+                pendingJob->finish();
+            });
+        }
+    }
+
+    /*
+    * Removes queued jobs and waits for the running ones.
+    * Removed jobs stop counting as pending; their groups
+    * never complete. Must be called before destroying
+    * anything the jobs use.
+    */
+    void cancelAllJobs()
+    {
+        pool.removeAllJobs(true, 4000);
+    }
+
+    /*
+    * Blocks until the queue is empty or the timeout expires.
+    * Returns true if every job has run.
+    */
+    bool waitUntilIdle(int timeoutMs)
+    {
+        auto endTime = Time::getMillisecondCounter() + (uint32) timeoutMs;
+
+        while (pending.load() > 0)
+        {
+            if (Time::getMillisecondCounter() >= endTime)
+                return false;
+
+            idle.wait(10);
+        }
+
+        return true;
+    }
+
+    /*
+    * Returns the number of jobs queued or running.
+    */
+    int getNumPendingJobs() const { return pending.load(); }
+
+    /*
+    * Returns the time it took to empty the queue the last time.
+    */
+    double getLastLoadTimeMs() const { return lastLoadTimeMs.load(); }
+
+    int getNumWorkers() const { return pool.getNumThreads(); }
+
+private:
+    /*
+    * Keeps a queued job counted in pending until it has run,
+    * or until the pool deletes it unrun when jobs are cancelled.
+    */
+    struct PendingJob
+    {
+        explicit PendingJob(SampleLoader& owner) : loader(owner) { }
+
+        ~PendingJob()
+        {
+            if (!finished)
+                loader.jobCancelled();
+        }
+
+        void finish()
+        {
+            finished = true;
+            loader.jobFinished();
+        }
+
+        SampleLoader& loader;
+        bool finished = false;
+    };
+
+    void jobFinished()
+    {
+        if (pending.fetch_sub(1) == 1)
+        {
+            auto elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - loadStartTicks.load());
+            lastLoadTimeMs = elapsed * 1000.0;
+
+            String msg;
+            msg << "Samples loaded in " << lastLoadTimeMs.load() << " ms (" << pool.getNumThreads() << " workers)";
+            DBG(msg);
+
+            idle.signal();
+        }
+    }
+
+    void jobCancelled()
+    {
+        if (pending.fetch_sub(1) == 1)
+            idle.signal();
+    }
+
+    ThreadPool pool;
+    WaitableEvent idle;
+    std::atomic<int> pending { 0 };
+    std::atomic<double> lastLoadTimeMs { 0.0 };
+    std::atomic<int64> loadStartTicks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleLoader)
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Streaming settings, read from mixer_info.xml.
+* When enabled, only the first preloadSamples of each
+* sample stay in memory and the rest is read from disk
+* into a per-voice ring of readAheadSamples.
+*/
+struct StreamingOptions
+{
+    bool enabled = false;
+    int preloadSamples = 16384;
+    int readAheadSamples = 8192;
+};
+
+/*
+* Something a StreamBuffer can read sample data from.
+* Only called from the streamer thread.
+*/
+class StreamSource
+{
+public:
+    virtual ~StreamSource() = default;
+
+    /*
+    * Reads numSamples starting at sourceStart into dest, from destStart.
+    */
+    virtual void readStreamSamples(AudioBuffer<float>& dest, int destStart, int64 sourceStart, int numSamples) = 0;
+
+    /*
+    * Returns the total length of the source in samples.
+    */
+    virtual int64 getStreamLength() const = 0;
+};
+
+/*
+* Ring buffer owned by a voice and filled by the SampleStreamer.
+* Slots are addressed by absolute source sample index, so the
+* voice reads source sample s from slot (s & mask) as long as
+* readPosition <= s < writePosition.
+*
+* Single producer (streamer thread), single consumer (audio thread).
+* Each start() bumps a generation counter, so data written for a
+* previous note is never read by the new one.
+*/
+class StreamBuffer
+{
+public:
+    StreamBuffer(int numChannels, int minSizeInSamples)
+        : size(nextPowerOfTwo(jmax(1024, minSizeInSamples)))
+        , mask(size - 1)
+        , buffer(numChannels, size)
+    {
+        buffer.clear();
+    }
+
+    //==============================================================================
+    // Audio thread
+
+    /*
+    * Starts streaming the given source from startSample.
+    * Passing nullptr stops streaming.
+    */
+    void start(StreamSource* sourceToStream, int64 startSample)
+    {
+        requestedSource.store(sourceToStream, std::memory_order_relaxed);
+        requestedStart.store(startSample, std::memory_order_relaxed);
+        startedGeneration = requestedGeneration.load(std::memory_order_relaxed) + 1;
+        requestedGeneration.store(startedGeneration, std::memory_order_release);
+    }
+
+    void stop() { start(nullptr, 0); }
+
+    /*
+    * Returns the index after the last source sample in the ring,
+    * or -1 if the streamer hasn't picked up the last start() yet.
+    */
+    int64 getReadyEnd() const
+    {
+        if (activeGeneration.load(std::memory_order_acquire) != startedGeneration)
+            return -1;
+
+        return writePosition.load(std::memory_order_acquire);
+    }
+
+    float getSample(int channel, int64 sourceSample) const noexcept
+    {
+        return buffer.getSample(channel, (int) (sourceSample & mask));
+    }
+
+    /*
+    * Gives back to the streamer all the slots before the given sample.
+    */
+    void releaseBefore(int64 sourceSample)
+    {
+        if (activeGeneration.load(std::memory_order_acquire) != startedGeneration)
+            return;
+
+        auto limit = writePosition.load(std::memory_order_acquire);
+        readPosition.store(jmin(sourceSample, limit), std::memory_order_release);
+    }
+
+    /*
+    * Counts the times the voice needed data not yet streamed.
+    */
+    void reportUnderrun() { underruns.fetch_add(1, std::memory_order_relaxed); }
+
+    int getNumUnderruns() const { return underruns.load(std::memory_order_relaxed); }
+
+    //==============================================================================
+    // Streamer thread
+
+    /*
+    * Reads up to maxSamples into the free part of the ring.
+    * Returns the number of samples read.
+    */
+    int service(int maxSamples)
+    {
+        auto generation = requestedGeneration.load(std::memory_order_acquire);
+
+        if (generation != servicedGeneration)
+        {
+            source = requestedSource.load(std::memory_order_relaxed);
+            auto start = requestedStart.load(std::memory_order_relaxed);
+
+            readPosition.store(start, std::memory_order_relaxed);
+            writePosition.store(start, std::memory_order_relaxed);
+            servicedGeneration = generation;
+            activeGeneration.store(generation, std::memory_order_release);
+        }
+
+        if (source == nullptr)
+            return 0;
+
+        auto write = writePosition.load(std::memory_order_relaxed);
+        auto read = readPosition.load(std::memory_order_acquire);
+        auto numToRead = (int) jmin((int64) maxSamples,
+                                    (int64) size - (write - read),
+                                    source->getStreamLength() - write);
+
+        if (numToRead <= 0)
+            return 0;
+
+        auto slot = (int) (write & mask);
+        auto firstPart = jmin(numToRead, size - slot);
+
+        source->readStreamSamples(buffer, slot, write, firstPart);
+
+        if (numToRead > firstPart)
+            source->readStreamSamples(buffer, 0, write + firstPart, numToRead - firstPart);
+
+        writePosition.store(write + numToRead, std::memory_order_release);
+        return numToRead;
+    }
+
+    int getSizeInBytes() const { return (int) (buffer.getNumChannels() * size * sizeof(float)); }
+
+private:
+    const int size, mask;
+    AudioBuffer<float> buffer;
+
+    // Written by the audio thread
+    std::atomic<StreamSource*> requestedSource { nullptr };
+    std::atomic<int64> requestedStart { 0 };
+    std::atomic<uint32> requestedGeneration { 0 };
+    std::atomic<int64> readPosition { 0 };
+    uint32 startedGeneration = 0;
+
+    // Written by the streamer thread
+    std::atomic<uint32> activeGeneration { 0 };
+    std::atomic<int64> writePosition { 0 };
+    StreamSource* source = nullptr;
+    uint32 servicedGeneration = 0;
+
+    std::atomic<int> underruns { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamBuffer)
+};
+
+/*
+* Background thread keeping every registered StreamBuffer filled.
+* The audio thread never touches the lock: it only talks to
+* each StreamBuffer through its atomics.
+*/
+class SampleStreamer : private Thread
+{
+public:
+    enum
+    {
+        chunkSize = 4096,
+        idleWaitMs = 2
+    };
+
+    SampleStreamer() : Thread("DrumSampler Streamer") { }
+
+    ~SampleStreamer()
+    {
+        stopThread(4000);
+    }
+
+    void addStream(StreamBuffer* stream)
+    {
+        {
+            const ScopedLock sl(lock);
+            streams.addIfNotAlreadyThere(stream);
+        }
+
+        if (!isThreadRunning())
+            startThread(7);
+    }
+
+    void removeStream(StreamBuffer* stream)
+    {
+        const ScopedLock sl(lock);
+        streams.removeFirstMatchingValue(stream);
+    }
+
+    /*
+    * Returns once no stream is being serviced. The next service
+    * of each stream sees every start() and stop() made before
+    * the call, so the sources they replaced are no longer read.
+    * Not for the audio thread.
+    */
+    void waitForCurrentPass()
+    {
+        const ScopedLock sl(lock);
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            auto numRead = 0;
+
+            {
+                const ScopedLock sl(lock);
+
+                for (auto* stream : streams)
+                    numRead += stream->service(chunkSize);
+            }
+
+            // Keep going while there's work, otherwise poll:
+            // waking up the thread from the audio callback would take a lock
+            if (numRead == 0)
+                wait(idleWaitMs);
+        }
+    }
+
+    CriticalSection lock;
+    Array<StreamBuffer*> streams;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleStreamer)
+};
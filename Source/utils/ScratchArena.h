@@ -0,0 +1,101 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Scratch audio buffers for the audio thread, all carved
+* out of one block allocated in prepareToPlay.
+*
+* The arena is sized for the largest block the host
+* announced, so any smaller block is served without
+* allocating: a slot just hands out a buffer referring to
+* the first numSamples frames of its channels.
+* Preparing again only reallocates if the arena has to grow.
+*/
+class ScratchArena
+{
+public:
+    enum
+    {
+        // Channels start on 16 byte boundaries for SIMD
+        alignment = 4
+    };
+
+    ScratchArena() { }
+
+    /*
+    * Makes room for numSlots buffers of numChannels channels
+    * and maxBlockSize frames each.
+    * Must not be called while rendering.
+    */
+    void prepare(int numSlotsToUse, int numChannelsToUse, int maxBlockSizeToUse)
+    {
+        auto stride = (jmax(1, maxBlockSizeToUse) + alignment - 1) / alignment * alignment;
+        auto needed = (size_t) jmax(1, numSlotsToUse) * (size_t) jmax(1, numChannelsToUse) * (size_t) stride;
+
+        if (needed + alignment > allocatedFloats)
+        {
+            allocatedFloats = needed + alignment;
+            memory.allocate(allocatedFloats, true);
+        }
+
+        numSlots = numSlotsToUse;
+        numChannels = numChannelsToUse;
+        maxBlockSize = maxBlockSizeToUse;
+        channelStride = stride;
+
+        // HeapBlock only guarantees malloc alignment
+        auto* base = memory.get();
+
+        while ((reinterpret_cast<pointer_sized_int>(base) & (alignment * sizeof(float) - 1)) != 0)
+            ++base;
+
+        alignedBase = base;
+    }
+
+    /*
+    * Returns a cleared buffer for the given slot,
+    * referring to the arena memory, numSamples frames long.
+    * numSamples must not exceed getMaxBlockSize().
+    */
+    AudioBuffer<float> getBuffer(int slot, int numSamples) const
+    {
+        jassert(isPositiveAndBelow(slot, numSlots));
+        jassert(numSamples <= maxBlockSize);
+
+        // AudioBuffer keeps up to 32 channel pointers inline,
+        // so referring to the arena doesn't allocate either
+        float* channels[maxChannels] = {};
+        auto numToUse = jmin(numChannels, (int) maxChannels);
+
+        for (auto ch = 0; ch < numToUse; ++ch)
+            channels[ch] = alignedBase + ((size_t) slot * (size_t) numChannels + (size_t) ch) * (size_t) channelStride;
+
+        AudioBuffer<float> result(channels, numToUse, jmin(numSamples, maxBlockSize));
+        result.clear();
+
+        return result;
+    }
+
+    int getMaxBlockSize() const { return maxBlockSize; }
+
+    int getNumSlots() const { return numSlots; }
+
+    int getNumChannels() const { return numChannels; }
+
+private:
+    enum
+    {
+        maxChannels = 16
+    };
+
+    HeapBlock<float> memory;
+    float* alignedBase = nullptr;
+    size_t allocatedFloats = 0;
+    int numSlots = 0;
+    int numChannels = 0;
+    int maxBlockSize = 0;
+    int channelStride = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ScratchArena)
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+* Hands a copyable snapshot from one writer thread to one
+* reader thread without locks: a triple buffer.
+*
+* The writer fills its own copy and swaps it with the spare one,
+* the reader swaps the spare one with its own if it's newer.
+* Neither ever waits for the other and the reader always gets
+* the latest complete snapshot, skipping the ones it missed.
+*/
+template <typename SnapshotType>
+class SnapshotExchange
+{
+public:
+    SnapshotExchange() { }
+
+    /*
+    * Copy the writer fills before calling publish().
+    */
+    SnapshotType& getWriteSnapshot() { return copies[writeIndex]; }
+
+    /*
+    * Makes the write snapshot the latest one.
+    * Called from the writer thread only.
+    */
+    void publish()
+    {
+        auto previous = spare.exchange(writeIndex | newFlag, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    /*
+    * Copies the latest snapshot into dest, if one was published
+    * since the last call, and returns true if it did.
+    * Called from the reader thread only.
+    */
+    bool read(SnapshotType& dest)
+    {
+        if ((spare.load(std::memory_order_relaxed) & newFlag) == 0)
+            return false;
+
+        auto previous = spare.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+        dest = copies[readIndex];
+        return true;
+    }
+
+private:
+    enum
+    {
+        indexMask = 3,
+        newFlag = 4
+    };
+
+    SnapshotType copies[3];
+    std::atomic<int> spare { 1 };
+    int writeIndex = 0;
+    int readIndex = 2;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SnapshotExchange)
+};